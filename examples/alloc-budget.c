@@ -0,0 +1,324 @@
+/*
+ * This example code is distributed as a part of the
+ * libreadconf library, and is provided as public domain,
+ * free of any license restrictions, for the convenience 
+ * of any developers looking to use the library.
+ *
+ * As such you are free to copy, redistribute, and reuse
+ * this code, or any part thereof, in any way, with or 
+ * without credit as to it's origin.
+ *
+ * YOU MAY NOT make claim that you are the originator of
+ * this code (unless you really are), or attempt take 
+ * legal action against others for using it, or any part 
+ * of it!
+ *
+ * This code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY, implied or otherwise.
+ * It is provided without guarantee of fitness for ANY
+ * purpose.
+ * In fact the creator implores you to NOT reuse it in ANY
+ * production program, and instead write your own, more
+ * appropriate, code.
+ *                                        --Luna
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <libreadconf.h>
+
+// This example checks how much memory reading a configuration
+// takes, and fails if it takes more than it should, so a
+// change that makes the library allocate more per key is
+// caught before it's released.
+//
+// Rather than interposing malloc(), it counts everything the
+// library allocates through config_set_allocator(). Every hook
+// is told the size of the block, so we can keep the live and
+// peak heap, and check that every block is freed with the size
+// it was allocated with.
+//
+// Each file is read normally and with CONFIG_LAZY, then read a
+// second time, searched, indexed, and closed. For each one we
+// report the allocations and bytes per entry taken by the
+// first read, the peak heap, and anything left over once the
+// CONFIG is closed.
+//
+// Blocks that are resized are only counted once. Buffers grow
+// by doubling, so a long line is resized a few times, and is
+// reported, but isn't held to a budget.
+//
+// Can be compiled using 'cc alloc-budget.c -lreadconf -o
+// alloc-budget', and run as './alloc-budget *.conf'.
+//
+// Files named on the command line are checked along with some
+// generated ones, which are written to new files, made with
+// mkstemp(), in the directory given by the TMPDIR environment
+// variable, or "/tmp".
+
+// The budgets.
+// These are what the library takes today, with some room to
+// spare. Raise them only on purpose.
+#define BUDGET_ALLOCS        2.5   // per entry, normal reads
+#define BUDGET_ALLOCS_LAZY   1.5   // per entry, lazy reads
+#define BUDGET_BYTES         128.0 // per entry, over twice the file size
+#define BUDGET_FIXED         16384 // bytes, for the CONFIG and buffers
+
+struct counts
+{
+	size_t calls;
+	size_t resizes;
+	size_t live;
+	size_t peak;
+	size_t blocks;
+	size_t bad;
+};
+
+static struct counts counts;
+
+// Blocks are prefixed with the size they were allocated with,
+// so we can check the size we're given back.
+#define HEAD sizeof(max_align_t)
+
+static void *count_alloc(size_t size, void *ctx)
+{
+	(void)ctx;
+
+	unsigned char *ptr = malloc(HEAD + size);
+	if(ptr == NULL)
+		return NULL;
+
+	*(size_t *)ptr = size;
+
+	counts.calls++;
+	counts.blocks++;
+	counts.live += size;
+	if(counts.live > counts.peak)
+		counts.peak = counts.live;
+
+	return ptr + HEAD;
+}
+
+static void *count_resize(void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+	(void)ctx;
+
+	unsigned char *head = (unsigned char *)ptr - HEAD;
+	if(*(size_t *)head != old_size)
+		counts.bad++;
+
+	head = realloc(head, HEAD + new_size);
+	if(head == NULL)
+		return NULL;
+
+	*(size_t *)head = new_size;
+
+	counts.resizes++;
+	counts.live += new_size - old_size;
+	if(counts.live > counts.peak)
+		counts.peak = counts.live;
+
+	return head + HEAD;
+}
+
+static void count_release(void *ptr, size_t size, void *ctx)
+{
+	(void)ctx;
+
+	unsigned char *head = (unsigned char *)ptr - HEAD;
+	if(*(size_t *)head != size)
+		counts.bad++;
+
+	counts.blocks--;
+	counts.live -= size;
+	free(head);
+}
+
+static const struct config_allocator counter = {count_alloc, count_resize, count_release, NULL};
+
+static int failed = 0;
+
+// Walks every key, so the sorted index is built and counted.
+static int ignore_key(const char *name, const char *data, void *arg)
+{
+	(void)name;
+	(void)data;
+	(void)arg;
+
+	return 0;
+}
+
+static void check_file(const char *path, int flags)
+{
+	memset(&counts, 0, sizeof(counts));
+
+	CONFIG *cfg = config_open_flags(path, flags);
+	if(cfg == NULL || config_read(cfg) == -1)
+	{
+		perror(path);
+		failed = 1;
+		if(cfg != NULL)
+			config_close(cfg);
+		return;
+	}
+
+	size_t calls = counts.calls;
+	size_t resizes = counts.resizes;
+	size_t used = counts.live;
+	size_t entries = 0;
+	config_sv name, data;
+
+	while(config_next_sv(cfg, &name, &data) == 1)
+		entries++;
+
+	struct stat info;
+	size_t size = (stat(path, &info) == 0) ? (size_t)info.st_size : 0;
+
+	// The rest is only here to be counted for leaks.
+	// Reading again from the end of the file gives an empty
+	// keylist, but mustn't lose what the first read had.
+	config_rewind(cfg);
+	if(entries > 0)
+	{
+		config_index_sv(cfg, &name, &data, (unsigned int)(entries - 1));
+		char *copy = strdup(name.ptr);
+		config_search_br(cfg, copy, &(char *){NULL});
+		config_prefix_iter(cfg, "", ignore_key, NULL);
+		free(copy);
+	}
+	config_read(cfg);
+
+	size_t peak = counts.peak;
+	config_close(cfg);
+
+	double per_entry = (entries > 0) ? (double)calls / entries : 0.0;
+	double bytes = (entries > 0) ? (double)used / entries : 0.0;
+	double allowed = (flags & CONFIG_LAZY) ? BUDGET_ALLOCS_LAZY : BUDGET_ALLOCS;
+	const char *problem = NULL;
+
+	if(counts.live != 0 || counts.blocks != 0)
+		problem = "leaked";
+	else if(counts.bad != 0)
+		problem = "freed with the wrong size";
+	else if(calls > (allowed * entries) + 4)
+		problem = "too many allocations";
+	else if(used > (2 * size) + (BUDGET_BYTES * entries) + BUDGET_FIXED)
+		problem = "too many bytes";
+	else if(peak > (2 * used) + BUDGET_FIXED)
+		problem = "peak too high";
+
+	printf("%-32s %-6s %7zu entries %5.2f allocs %9.1f bytes per entry, %4zu resizes, peak %9zu, leaked %zu%s%s\n",
+		path, (flags & CONFIG_LAZY) ? "lazy" : "normal", entries, per_entry, bytes, resizes, peak, counts.live,
+		(problem != NULL) ? " -- FAIL: " : "", (problem != NULL) ? problem : "");
+
+	if(problem != NULL)
+		failed = 1;
+}
+
+// Makes a new file from 'path', a template for mkstemp(), so
+// runs at the same time don't write over each other's files.
+static FILE *make_file(char *path)
+{
+	int fd = mkstemp(path);
+	if(fd == -1)
+		return NULL;
+
+	FILE *file = fdopen(fd, "w");
+	if(file == NULL)
+	{
+		close(fd);
+		remove(path);
+	}
+
+	return file;
+}
+
+// Writes 'count' keys with short, repeated values, with a tag
+// and a comment every so often.
+static int write_keys(char *path, size_t count)
+{
+	FILE *file = make_file(path);
+	if(file == NULL)
+		return -1;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(i % 100 == 0)
+			fprintf(file, "[section%zu]\n# keys %zu onwards\n", (i / 100), i);
+
+		fprintf(file, "key%zu = %s\n", i, (i % 2) ? "true" : "host.example.com");
+	}
+
+	return fclose(file);
+}
+
+// Writes a few keys with long values.
+static int write_long(char *path, size_t count, size_t size)
+{
+	FILE *file = make_file(path);
+	if(file == NULL)
+		return -1;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		fprintf(file, "value%zu = ", i);
+		for(size_t j = 0; j < size; j++)
+			fputc('a' + (j % 26), file);
+		fputc('\n', file);
+	}
+
+	return fclose(file);
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	char keys[4096], longs[4096];
+
+	if(config_set_allocator(NULL, &counter) == -1)
+	{
+		perror("config_set_allocator");
+		return 1;
+	}
+
+	snprintf(keys, sizeof(keys), "%s/alloc-budget-keys-XXXXXX", dir);
+	snprintf(longs, sizeof(longs), "%s/alloc-budget-long-XXXXXX", dir);
+
+	if(write_keys(keys, 20000) != 0)
+	{
+		perror(dir);
+		return 1;
+	}
+
+	if(write_long(longs, 16, 100000) != 0)
+	{
+		perror(dir);
+		remove(keys);
+		return 1;
+	}
+
+	for(int i = 1; i < argc; i++)
+	{
+		check_file(argv[i], 0);
+		check_file(argv[i], CONFIG_LAZY);
+	}
+
+	check_file(keys, 0);
+	check_file(keys, CONFIG_LAZY);
+	check_file(longs, 0);
+	check_file(longs, CONFIG_LAZY);
+
+	remove(keys);
+	remove(longs);
+
+	if(failed)
+	{
+		printf("Over budget!\n");
+		return 1;
+	}
+
+	printf("All within budget.\n");
+	return 0;
+}
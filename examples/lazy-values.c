@@ -0,0 +1,244 @@
+/*
+ * This example code is distributed as a part of the
+ * libreadconf library, and is provided as public domain,
+ * free of any license restrictions, for the convenience
+ * of any developers looking to use the library.
+ *
+ * As such you are free to copy, redistribute, and reuse
+ * this code, or any part thereof, in any way, with or
+ * without credit as to it's origin.
+ *
+ * YOU MAY NOT make claim that you are the originator of
+ * this code (unless you really are), or attempt take
+ * legal action against others for using it, or any part
+ * of it!
+ *
+ * This code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY, implied or otherwise.
+ * It is provided without guarantee of fitness for ANY
+ * purpose.
+ * In fact the creator implores you to NOT reuse it in ANY
+ * production program, and instead write your own, more
+ * appropriate, code.
+ *                                        --Luna
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <libreadconf.h>
+
+// This example checks that a configuration read with
+// CONFIG_LAZY binds, maps, and looks up the same values as one
+// read normally, including keys whose values are empty, which are
+// easy to mistake for items that aren't keys at all.
+//
+// It writes a small file to the directory given by the TMPDIR
+// environment variable, or "/tmp", binds and maps it both
+// ways, and exits with 1 if they don't agree.
+//
+// Can be compiled using 'cc lazy-values.c -lreadconf -o
+// lazy-values'.
+
+static const char text[] =
+	"# Keys with empty values, and one that isn't a key.\n"
+	"name = example\n"
+	"empty =\n"
+	"blank =    \n"
+	"verbose\n"
+	"last=";
+
+struct settings
+{
+	config_sv name;
+	config_sv empty;
+	config_sv blank;
+	config_sv last;
+};
+
+static const struct config_field fields[] =
+{
+	{"name",  CONFIG_TYPE_SV, offsetof(struct settings, name),  0, CONFIG_FIELD_REQUIRED},
+	{"empty", CONFIG_TYPE_SV, offsetof(struct settings, empty), 0, CONFIG_FIELD_REQUIRED},
+	{"blank", CONFIG_TYPE_SV, offsetof(struct settings, blank), 0, CONFIG_FIELD_REQUIRED},
+	{"last",  CONFIG_TYPE_SV, offsetof(struct settings, last),  0, CONFIG_FIELD_REQUIRED},
+};
+
+#define FIELD_COUNT (sizeof(fields) / sizeof(fields[0]))
+
+// A schema for config_map(), written by hand.
+// Larger ones are best written by the libreadconf-schema tool.
+static const char *const names[] = {"name", "empty", "blank", "last"};
+
+static int slot(const char *name, size_t len)
+{
+	for(size_t i = 0; i < FIELD_COUNT; i++)
+	{
+		if(strlen(names[i]) == len && memcmp(names[i], name, len) == 0)
+			return i;
+	}
+
+	return -1;
+}
+
+static const struct config_schema schema = {FIELD_COUNT, names, slot};
+
+static void report(int problem, const char *name, const char *data, void *arg)
+{
+	(void)data;
+	printf("  %s: \"%s\" was %s\n", (const char *)arg, name, (problem == CONFIG_BIND_MISSING) ? "missing" : "rejected");
+}
+
+// Checks a set of values found by either function.
+static int values_ok(const config_sv *name, const config_sv *empty, const config_sv *blank, const config_sv *last)
+{
+	if(name->ptr == NULL || name->len != 7 || memcmp(name->ptr, "example", 7) != 0)
+		return 0;
+
+	if(empty->ptr == NULL || empty->len != 0 || blank->ptr == NULL || blank->len != 0
+		|| last->ptr == NULL || last->len != 0)
+		return 0;
+
+	return 1;
+}
+
+// Opens and reads 'path' with 'flags'.
+static CONFIG *load(const char *path, int flags)
+{
+	CONFIG *cfg = config_open_flags(path, flags);
+	if(cfg == NULL || config_read(cfg) == -1)
+	{
+		perror(path);
+		if(cfg != NULL)
+			config_close(cfg);
+		return NULL;
+	}
+
+	return cfg;
+}
+
+// Binds 'path' with 'flags', and checks every field was found
+// with the value we expect.
+//
+// Each check reads the file again, as lazy values are trimmed
+// once they're used, and would hide the problem from the next.
+static int check_bind(const char *path, int flags, const char *mode)
+{
+	struct settings out;
+	int ok = 1;
+
+	memset(&out, 0, sizeof(out));
+
+	CONFIG *cfg = load(path, flags);
+	if(cfg == NULL)
+		return 0;
+
+	int bound = config_bind_report(cfg, fields, FIELD_COUNT, &out, report, (void *)mode);
+	if(bound != (int)FIELD_COUNT)
+	{
+		printf("  %s: bound %d of %zu fields\n", mode, bound, FIELD_COUNT);
+		ok = 0;
+	}
+
+	if(!values_ok(&out.name, &out.empty, &out.blank, &out.last))
+		ok = 0;
+
+	printf("%s bind: %s\n", mode, ok ? "ok" : "FAILED");
+
+	config_close(cfg);
+	return ok;
+}
+
+// The same, with config_map().
+static int check_map(const char *path, int flags, const char *mode)
+{
+	config_sv slots[FIELD_COUNT];
+	int ok = 1;
+
+	CONFIG *cfg = load(path, flags);
+	if(cfg == NULL)
+		return 0;
+
+	int mapped = config_map_report(cfg, &schema, slots, report, (void *)mode);
+	if(mapped != (int)FIELD_COUNT)
+	{
+		printf("  %s: mapped %d of %zu slots\n", mode, mapped, FIELD_COUNT);
+		ok = 0;
+	}
+
+	if(mapped != -1 && !values_ok(&slots[0], &slots[1], &slots[2], &slots[3]))
+		ok = 0;
+
+	printf("%s map: %s\n", mode, ok ? "ok" : "FAILED");
+
+	config_close(cfg);
+	return ok;
+}
+
+// The same, with config_lookup_sv(), which must also leave every
+// value terminated, so it can be used as a C string.
+static int check_lookup(const char *path, int flags, const char *mode)
+{
+	config_sv found[FIELD_COUNT];
+	int ok = 1;
+
+	CONFIG *cfg = load(path, flags);
+	if(cfg == NULL)
+		return 0;
+
+	for(size_t i = 0; i < FIELD_COUNT; i++)
+	{
+		config_sv name = {names[i], strlen(names[i])};
+
+		if(config_lookup_sv(cfg, name, &found[i]) != 1 || strlen(found[i].ptr) != found[i].len)
+		{
+			printf("  %s: \"%s\" was looked up wrong\n", mode, names[i]);
+			ok = 0;
+		}
+	}
+
+	if(ok && !values_ok(&found[0], &found[1], &found[2], &found[3]))
+		ok = 0;
+
+	printf("%s lookup: %s\n", mode, ok ? "ok" : "FAILED");
+
+	config_close(cfg);
+	return ok;
+}
+
+int main(void)
+{
+	const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+	char path[4096];
+
+	snprintf(path, sizeof(path), "%s/lazy-values-XXXXXX", dir);
+
+	int fd = mkstemp(path);
+	if(fd == -1)
+	{
+		perror(path);
+		return 1;
+	}
+
+	if(write(fd, text, (sizeof(text) - 1)) != (ssize_t)(sizeof(text) - 1))
+	{
+		perror(path);
+		close(fd);
+		unlink(path);
+		return 1;
+	}
+
+	close(fd);
+
+	int ok = check_bind(path, 0, "normal");
+	ok &= check_bind(path, CONFIG_LAZY, "lazy");
+	ok &= check_map(path, 0, "normal");
+	ok &= check_map(path, CONFIG_LAZY, "lazy");
+	ok &= check_lookup(path, 0, "normal");
+	ok &= check_lookup(path, CONFIG_LAZY, "lazy");
+
+	unlink(path);
+
+	return ok ? 0 : 1;
+}
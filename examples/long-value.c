@@ -0,0 +1,127 @@
+/*
+ * This example code is distributed as a part of the
+ * libreadconf library, and is provided as public domain,
+ * free of any license restrictions, for the convenience 
+ * of any developers looking to use the library.
+ *
+ * As such you are free to copy, redistribute, and reuse
+ * this code, or any part thereof, in any way, with or 
+ * without credit as to it's origin.
+ *
+ * YOU MAY NOT make claim that you are the originator of
+ * this code (unless you really are), or attempt take 
+ * legal action against others for using it, or any part 
+ * of it!
+ *
+ * This code is distributed in the hope that it will be
+ * useful, but WITHOUT ANY WARRANTY, implied or otherwise.
+ * It is provided without guarantee of fitness for ANY
+ * purpose.
+ * In fact the creator implores you to NOT reuse it in ANY
+ * production program, and instead write your own, more
+ * appropriate, code.
+ *                                        --Luna
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <libreadconf.h>
+
+// This example times reading a configuration holding a single
+// very long value, such as an inlined certificate, with and
+// without CONFIG_LAZY.
+// Reading should take time in proportion to the size of the
+// file, so the 64MB case should take roughly 64 times as long
+// as the 1MB one, and not thousands of times.
+//
+// Can be compiled using 'cc -lreadconf long-value.c -o
+// long-value'.
+//
+// The test files are written to the directory given as the
+// first argument, or "/tmp".
+
+static double now_ms(void)
+{
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+
+	return (ts.tv_sec * 1000.0) + (ts.tv_nsec / 1000000.0);
+}
+
+// Writes a file with a key either side of one long value, so
+// we can check that nothing around it gets lost.
+static int write_file(const char *path, size_t size)
+{
+	FILE *file = fopen(path, "w");
+	if(file == NULL)
+		return -1;
+
+	fputs("before = 1\ncert = ", file);
+	for(size_t i = 0; i < size; i++)
+		fputc('A' + (i % 26), file);
+	fputs("\nafter = 2\n", file);
+
+	return fclose(file);
+}
+
+static int time_read(const char *path, size_t size, int flags)
+{
+	double start = now_ms();
+
+	CONFIG *cfg = config_open_flags(path, flags);
+	if(cfg == NULL)
+		return -1;
+
+	if(config_read(cfg) == -1)
+	{
+		config_close(cfg);
+		return -1;
+	}
+
+	// We use the string-view functions, so the check below
+	// doesn't need to call strlen() on the value.
+	config_sv value;
+	config_sv name = {"cert", 4};
+	if(config_search_sv(cfg, name, &value) != 1 || value.len != size)
+	{
+		fprintf(stderr, "%s: the value is the wrong size!\n", path);
+		config_close(cfg);
+		return -1;
+	}
+
+	double taken = now_ms() - start;
+	config_close(cfg);
+
+	printf("%3zuMB value, %-6s %9.2f ms\n", (size >> 20), (flags & CONFIG_LAZY) ? "lazy:" : "normal:", taken);
+
+	return 0;
+}
+
+int main(int argc, char **argv)
+{
+	const char *dir = (argc > 1) ? argv[1] : "/tmp";
+	const size_t sizes[] = {1 << 20, 64 << 20};
+	char path[4096];
+
+	for(size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++)
+	{
+		snprintf(path, sizeof(path), "%s/long-value-%zuMB.conf", dir, (sizes[i] >> 20));
+
+		if(write_file(path, sizes[i]) != 0)
+		{
+			perror(path);
+			return 1;
+		}
+
+		if(time_read(path, sizes[i], 0) != 0 || time_read(path, sizes[i], CONFIG_LAZY) != 0)
+		{
+			remove(path);
+			return 1;
+		}
+
+		remove(path);
+	}
+
+	return 0;
+}
@@ -3,3 +3,5 @@ WDIR = .
 SUFFIX = 
 TARGETDIR = /lib
 INCLUDEDIR = /usr/include
+BINDIR = /usr/bin
+CPPFLAGS = 
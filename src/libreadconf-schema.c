@@ -0,0 +1,509 @@
+/*
+ * This file is part of libreadconf.
+ *
+ * libreadconf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * libreadconf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libreadconf.  If not, see <https://www.gnu.org/licenses/>.
+ */
+
+// libreadconf-schema
+//
+// Reads a schema, a configuration file listing every key a
+// program knows about, and writes a C header holding an enum
+// of slots and a minimal perfect hash for them, for use with
+// config_map().
+//
+// The hash is "hash and displace". Every key is hashed once
+// to pick a bucket, and each bucket is given a seed that sends
+// all of its keys to free slots when they're hashed again.
+// Buckets holding a single key skip the second hash, and store
+// their slot directly.
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <errno.h>
+#include <unistd.h>
+#include "libreadconf.h"
+
+// How many seeds we try for a bucket before giving up.
+// With one bucket per key this is never close to being hit.
+#define SEED_MAX 0x1000000
+
+struct schema_key
+{
+	const char *name;
+	size_t      len;
+	char       *ident;
+	uint32_t    bucket;
+};
+
+static const char *prog = "libreadconf-schema";
+
+static unsigned char fold_char(unsigned char c)
+{
+	if(c >= 'A' && c <= 'Z')
+		return c + ('a' - 'A');
+	else
+		return c;
+}
+
+// This must match the hash written to the header by
+// write_header().
+static uint32_t key_hash(const char *name, size_t len, uint32_t seed, int fold)
+{
+	uint32_t hash = UINT32_C(2166136261) ^ (seed * UINT32_C(0x9e3779b9));
+
+	for(size_t i = 0; i < len; i++)
+	{
+		hash ^= fold ? fold_char(name[i]) : (unsigned char)name[i];
+		hash *= UINT32_C(16777619);
+	}
+
+	hash ^= hash >> 16;
+	hash *= UINT32_C(0x85ebca6b);
+	hash ^= hash >> 13;
+
+	return hash;
+}
+
+static int name_cmp(const char *name1, const char *name2, size_t len, int fold)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		unsigned char c1 = fold ? fold_char(name1[i]) : (unsigned char)name1[i];
+		unsigned char c2 = fold ? fold_char(name2[i]) : (unsigned char)name2[i];
+
+		if(c1 != c2)
+			return c1 - c2;
+	}
+
+	return 0;
+}
+
+static int ident_cmp(const void *key1, const void *key2)
+{
+	return strcmp(((const struct schema_key *)key1)->ident, ((const struct schema_key *)key2)->ident);
+}
+
+// Turns a key name into an identifier for the enum, by
+// upper-casing it, and replacing anything that can't go in an
+// identifier with '_'.
+static char *make_ident(const char *prefix, const char *name)
+{
+	size_t size = strlen(prefix) + strlen(name) + 2;
+	char *ident = malloc(size);
+	if(ident == NULL)
+		return NULL;
+
+	size_t pos = 0;
+
+	for(const char *c = prefix; *c != '\0'; c++)
+		ident[pos++] = (*c >= 'a' && *c <= 'z') ? *c - ('a' - 'A') : *c;
+	ident[pos++] = '_';
+
+	for(const char *c = name; *c != '\0'; c++)
+	{
+		if(*c >= 'a' && *c <= 'z')
+			ident[pos++] = *c - ('a' - 'A');
+		else if((*c >= 'A' && *c <= 'Z') || (*c >= '0' && *c <= '9'))
+			ident[pos++] = *c;
+		else
+			ident[pos++] = '_';
+	}
+
+	ident[pos] = '\0';
+	return ident;
+}
+
+// Finds the displacement of every bucket.
+// 'disp' is filled with the seed of each bucket holding more
+// than one key, or -(slot + 1) for buckets holding one, and
+// 'slots' with the key stored in each slot.
+//
+// Returns 0 on success, or -1 if no seed can be found.
+static int build_hash(struct schema_key *keys, size_t count, int fold, int32_t *disp, size_t *slots)
+{
+	size_t *start = calloc(count + 1, sizeof(size_t));
+	size_t *members = malloc(count * sizeof(size_t));
+	size_t *order = malloc(count * sizeof(size_t));
+	size_t *try = malloc(count * sizeof(size_t));
+	char *used = calloc(count, 1);
+	int ret = -1;
+
+	if(start == NULL || members == NULL || order == NULL || try == NULL || used == NULL)
+		goto done;
+
+	// Group the keys by bucket, so the keys of bucket 'b' are
+	// members[start[b]] to members[start[b + 1] - 1].
+	for(size_t i = 0; i < count; i++)
+	{
+		keys[i].bucket = key_hash(keys[i].name, keys[i].len, 0, fold) % count;
+		start[keys[i].bucket + 1]++;
+		disp[i] = 0;
+	}
+
+	for(size_t b = 0; b < count; b++)
+		start[b + 1] += start[b];
+
+	size_t largest = 0;
+	for(size_t b = 0; b < count; b++)
+	{
+		order[b] = start[b];
+		if(start[b + 1] - start[b] > largest)
+			largest = start[b + 1] - start[b];
+	}
+
+	for(size_t i = 0; i < count; i++)
+		members[order[keys[i].bucket]++] = i;
+
+	// Fullest buckets first, while there's still room to move
+	// their keys around.
+	// Buckets only ever hold a handful of keys, so this takes a
+	// handful of passes.
+	size_t buckets = 0;
+	for(size_t size = largest; size > 0; size--)
+	{
+		for(size_t b = 0; b < count; b++)
+		{
+			if(start[b + 1] - start[b] == size)
+				order[buckets++] = b;
+		}
+	}
+
+	size_t free_slot = 0;
+
+	for(size_t n = 0; n < buckets; n++)
+	{
+		size_t b = order[n];
+		size_t first = start[b], size = start[b + 1] - start[b];
+
+		if(size == 1)
+		{
+			while(used[free_slot])
+				free_slot++;
+
+			used[free_slot] = 1;
+			slots[free_slot] = members[first];
+			disp[b] = -(int32_t)free_slot - 1;
+			continue;
+		}
+
+		uint32_t seed;
+		for(seed = 1; seed < SEED_MAX; seed++)
+		{
+			size_t placed = 0;
+
+			for(; placed < size; placed++)
+			{
+				const struct schema_key *key = &keys[members[first + placed]];
+				size_t slot = key_hash(key->name, key->len, seed, fold) % count;
+				if(used[slot])
+					break;
+
+				try[placed] = slot;
+				used[slot] = 1;
+			}
+
+			if(placed == size)
+				break;
+
+			while(placed > 0)
+				used[try[--placed]] = 0;
+		}
+
+		if(seed == SEED_MAX)
+			goto done;
+
+		for(size_t i = 0; i < size; i++)
+			slots[try[i]] = members[first + i];
+
+		disp[b] = (int32_t)seed;
+	}
+
+	ret = 0;
+
+done:
+	free(start);
+	free(members);
+	free(order);
+	free(try);
+	free(used);
+	return ret;
+}
+
+static void write_string(FILE *out, const char *str, size_t len)
+{
+	fputc('"', out);
+
+	for(size_t i = 0; i < len; i++)
+	{
+		unsigned char c = str[i];
+
+		if(c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if(c < ' ' || c > '~')
+			fprintf(out, "\\%03o", c);
+		else
+			fputc(c, out);
+	}
+
+	fputc('"', out);
+}
+
+static void write_header(FILE *out, const char *source, const char *prefix, const char *upper, struct schema_key *keys, size_t count, int fold, const int32_t *disp, const size_t *slots)
+{
+	fprintf(out, "// Written by libreadconf-schema from \"%s\".\n", source);
+	fprintf(out, "// Do not edit.\n");
+	fprintf(out, "#ifndef %s_SCHEMA_H\n#define %s_SCHEMA_H\n\n", upper, upper);
+	fprintf(out, "#include <stddef.h>\n#include <stdint.h>\n#include <libreadconf.h>\n\n");
+
+	fprintf(out, "#ifdef __GNUC__\n#define %s_UNUSED __attribute__((unused))\n#else\n#define %s_UNUSED\n#endif\n\n", upper, upper);
+
+	fprintf(out, "enum %s_slot\n{\n", prefix);
+	for(size_t i = 0; i < count; i++)
+		fprintf(out, "\t%s,\n", keys[slots[i]].ident);
+	fprintf(out, "\t%s_COUNT\n};\n\n", upper);
+
+	fprintf(out, "static const char *const %s_names[%s_COUNT] =\n{\n", prefix, upper);
+	for(size_t i = 0; i < count; i++)
+	{
+		fputc('\t', out);
+		write_string(out, keys[slots[i]].name, keys[slots[i]].len);
+		fprintf(out, "%s\n", (i + 1 < count) ? "," : "");
+	}
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const size_t %s_lens[%s_COUNT] =\n{\n", prefix, upper);
+	for(size_t i = 0; i < count; i++)
+		fprintf(out, "\t%zu%s\n", keys[slots[i]].len, (i + 1 < count) ? "," : "");
+	fprintf(out, "};\n\n");
+
+	fprintf(out, "static const int32_t %s_disp[%s_COUNT] =\n{", prefix, upper);
+	for(size_t i = 0; i < count; i++)
+		fprintf(out, "%s%ld%s", (i % 8 == 0) ? "\n\t" : " ", (long)disp[i], (i + 1 < count) ? "," : "");
+	fprintf(out, "\n};\n\n");
+
+	fprintf(out, "static inline unsigned char %s_fold(unsigned char c)\n{\n", prefix);
+	if(fold)
+		fprintf(out, "\treturn (c >= 'A' && c <= 'Z') ? c + ('a' - 'A') : c;\n}\n\n");
+	else
+		fprintf(out, "\treturn c;\n}\n\n");
+
+	fprintf(out,
+		"static inline uint32_t %s_hash(const char *name, size_t len, uint32_t seed)\n"
+		"{\n"
+		"\tuint32_t hash = UINT32_C(2166136261) ^ (seed * UINT32_C(0x9e3779b9));\n"
+		"\n"
+		"\tfor(size_t i = 0; i < len; i++)\n"
+		"\t{\n"
+		"\t\thash ^= %s_fold((unsigned char)name[i]);\n"
+		"\t\thash *= UINT32_C(16777619);\n"
+		"\t}\n"
+		"\n"
+		"\thash ^= hash >> 16;\n"
+		"\thash *= UINT32_C(0x85ebca6b);\n"
+		"\thash ^= hash >> 13;\n"
+		"\n"
+		"\treturn hash;\n"
+		"}\n\n", prefix, prefix);
+
+	fprintf(out,
+		"// Returns the slot of 'name', or -1 if it isn't in the schema.\n"
+		"static inline int %s_slot(const char *name, size_t len)\n"
+		"{\n"
+		"\tint32_t disp = %s_disp[%s_hash(name, len, 0) %% %s_COUNT];\n"
+		"\tint slot = (disp < 0) ? (int)(-disp - 1) : (int)(%s_hash(name, len, (uint32_t)disp) %% %s_COUNT);\n"
+		"\n"
+		"\tif(len != %s_lens[slot])\n"
+		"\t\treturn -1;\n"
+		"\n"
+		"\tfor(size_t i = 0; i < len; i++)\n"
+		"\t{\n"
+		"\t\tif(%s_fold((unsigned char)name[i]) != %s_fold((unsigned char)%s_names[slot][i]))\n"
+		"\t\t\treturn -1;\n"
+		"\t}\n"
+		"\n"
+		"\treturn slot;\n"
+		"}\n\n", prefix, prefix, prefix, upper, prefix, upper, prefix, prefix, prefix, prefix);
+
+	fprintf(out, "static const struct config_schema %s_schema %s_UNUSED =\n{\n", prefix, upper);
+	fprintf(out, "\t%s_COUNT,\n\t%s_names,\n\t%s_slot\n};\n\n", upper, prefix, prefix);
+
+	fprintf(out, "#endif\n");
+}
+
+static void usage(void)
+{
+	fprintf(stderr, "usage: %s [-i] [-p prefix] [-o output] schema\n", prog);
+}
+
+int main(int argc, char **argv)
+{
+	const char *prefix = "schema";
+	const char *output = NULL;
+	int fold = 0;
+	int opt;
+
+	while((opt = getopt(argc, argv, "ip:o:")) != -1)
+	{
+		switch(opt)
+		{
+			case 'i':
+				fold = 1;
+				break;
+			case 'p':
+				prefix = optarg;
+				break;
+			case 'o':
+				output = optarg;
+				break;
+			default:
+				usage();
+				return 2;
+		}
+	}
+
+	if(optind != argc - 1)
+	{
+		usage();
+		return 2;
+	}
+
+	const char *source = argv[optind];
+
+	if(prefix[0] == '\0' || (prefix[0] >= '0' && prefix[0] <= '9') || prefix[strspn(prefix, "abcdefghijklmnopqrstuvwxyzABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789_")] != '\0')
+	{
+		fprintf(stderr, "%s: \"%s\" isn't a valid prefix\n", prog, prefix);
+		return 2;
+	}
+
+	// The schema is a configuration file itself.
+	// Every item is part of the schema, whether it has a value
+	// or not, so it may be a plain list of names. Values are
+	// left for notes.
+	CONFIG *cfg = config_open(source);
+	if(cfg == NULL || config_read(cfg) == -1)
+	{
+		fprintf(stderr, "%s: %s: %s\n", prog, source, strerror(errno));
+		return 1;
+	}
+
+	size_t count = 0, size = 0;
+	struct schema_key *keys = NULL;
+	config_sv name, data;
+
+	while(config_next_sv(cfg, &name, &data) == 1)
+	{
+		if(count == size)
+		{
+			size = size ? size * 2 : 64;
+			struct schema_key *temp = realloc(keys, size * sizeof(struct schema_key));
+			if(temp == NULL)
+			{
+				fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+				return 1;
+			}
+			keys = temp;
+		}
+
+		keys[count].name = name.ptr;
+		keys[count].len = name.len;
+		keys[count].ident = make_ident(prefix, name.ptr);
+		if(keys[count].ident == NULL)
+		{
+			fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+			return 1;
+		}
+
+		count++;
+	}
+
+	if(count == 0)
+	{
+		fprintf(stderr, "%s: %s: no keys\n", prog, source);
+		return 1;
+	}
+
+	if(count > INT32_MAX)
+	{
+		fprintf(stderr, "%s: %s: too many keys\n", prog, source);
+		return 1;
+	}
+
+	// Names that are the same, or only differ in case or in
+	// characters that can't go in an identifier, end up with the
+	// same identifier, so one sort finds them all.
+	qsort(keys, count, sizeof(struct schema_key), ident_cmp);
+
+	for(size_t i = 1; i < count; i++)
+	{
+		const struct schema_key *key1 = &keys[i - 1], *key2 = &keys[i];
+
+		if(strcmp(key1->ident, key2->ident) != 0)
+			continue;
+
+		if(key1->len == key2->len && name_cmp(key1->name, key2->name, key1->len, fold) == 0)
+			fprintf(stderr, "%s: %s: \"%s\" is listed more than once\n", prog, source, key2->name);
+		else
+			fprintf(stderr, "%s: %s: \"%s\" and \"%s\" would both be %s\n", prog, source, key1->name, key2->name, key2->ident);
+		return 1;
+	}
+
+	int32_t *disp = malloc(count * sizeof(int32_t));
+	size_t *slots = malloc(count * sizeof(size_t));
+	if(disp == NULL || slots == NULL)
+	{
+		fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+		return 1;
+	}
+
+	if(build_hash(keys, count, fold, disp, slots) == -1)
+	{
+		fprintf(stderr, "%s: %s: couldn't find a perfect hash\n", prog, source);
+		return 1;
+	}
+
+	char *upper = make_ident(prefix, "");
+	if(upper == NULL)
+	{
+		fprintf(stderr, "%s: %s\n", prog, strerror(errno));
+		return 1;
+	}
+	upper[strlen(upper) - 1] = '\0';
+
+	FILE *out = (output != NULL) ? fopen(output, "w") : stdout;
+	if(out == NULL)
+	{
+		fprintf(stderr, "%s: %s: %s\n", prog, output, strerror(errno));
+		return 1;
+	}
+
+	write_header(out, source, prefix, upper, keys, count, fold, disp, slots);
+
+	if(fflush(out) != 0 || (output != NULL && fclose(out) != 0))
+	{
+		fprintf(stderr, "%s: %s: %s\n", prog, (output != NULL) ? output : "stdout", strerror(errno));
+		return 1;
+	}
+
+	for(size_t i = 0; i < count; i++)
+		free(keys[i].ident);
+	free(keys);
+	free(disp);
+	free(slots);
+	free(upper);
+	config_close(cfg);
+
+	return 0;
+}
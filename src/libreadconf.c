@@ -15,14 +15,37 @@
  * along with libreadconf.  If not, see <https://www.gnu.org/licenses/>.
  */
 #include <sys/stat.h>
+#include <stdio.h>
 #include <string.h>
 #include <signal.h>
 #include <stddef.h>
+#include <stdint.h>
+#include <limits.h>
 #include <unistd.h>
 #include <stdlib.h>
 #include <errno.h>
 #include <fcntl.h>
+#ifndef NO_PTHREAD
+#include <pthread.h>
+#include <sched.h>
+#endif
+#include <stdatomic.h>
+#ifndef NO_SHM
+#include <sys/mman.h>
+#endif
+#ifdef HAVE_IO_URING
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include <linux/stat.h>
+// glibc only has this with _GNU_SOURCE, but it's the same on
+// every Linux.
+#ifndef AT_EMPTY_PATH
+	#define AT_EMPTY_PATH 0x1000
+#endif
+#endif
 #include "libreadconf.h"
+#include "libreadconf_inline.h"
 
 #define SIGMASK_SET 0
 #define SIGMASK_RST 1
@@ -31,21 +54,93 @@
 	#define BUFF_MIN 512
 #endif
 
+// The states of our tokenizer.
+// These are kept in the CONFIG between chunks of input, so a
+// line can be split anywhere.
+#define TOK_START   0
+#define TOK_NAME    1
+#define TOK_SPACE   2
+#define TOK_VALUE   3
+#define TOK_COMMENT 4
+
+// What a CONFIG opened with CONFIG_APPEND knows about the
+// part of its file it has already read.
+#define APPEND_OFF   0
+#define APPEND_TRACK 1
+#define APPEND_READY 2
+
+// Character classes for the tokenizer.
+#define CC_SPACE   0x01
+#define CC_NUL     0x02
+#define CC_NEWLINE 0x04
+#define CC_HASH    0x08
+#define CC_EQUALS  0x10
+
 // sigprocmask() isn't thread safe, but we'll still allow
 // people to use it over pthread_sigmask() if they want.
+//
+// The saved mask is per-thread too, as the signal mask itself
+// is.
 #ifdef NO_PTHREAD
     #define SIGPROCMASK_(HOW, SET, OLDSET) sigprocmask(HOW, SET, OLDSET)
+    #define THREAD_LOCAL_
 #else
     #define SIGPROCMASK_(HOW, SET, OLDSET) pthread_sigmask(HOW, SET, OLDSET)
+    #define THREAD_LOCAL_ _Thread_local
+#endif
+
+// The most threads config_open_many() will start.
+#ifndef OPEN_THREADS_MAX
+	#define OPEN_THREADS_MAX 32
 #endif
 
+// How many files each thread of config_open_many() has in
+// flight at once through io_uring, and the most each of them
+// reads at a time.
+#ifndef OPEN_RING_FILES
+	#define OPEN_RING_FILES 32
+#endif
+#ifndef OPEN_RING_READ
+	#define OPEN_RING_READ (256 * 1024)
+#endif
+
+struct share_image;
+struct override_map;
+struct value_slot;
+struct config_sub;
+struct config_snapshot;
+
 typedef struct k_list
 {
 	char           *name;
 	char	       *value;
+	size_t          name_len;
+	size_t          value_len;
+	size_t          name_size;
+	uint32_t        name_hash;
+	char            loaded;
+	char            pooled;
 	struct k_list  *key_next;
 } k_list;
 
+// What a key has taken from an intern pool.
+// When only the name is pooled, the buffer the key owns holds
+// its value, and starts at 'value' rather than 'name'.
+#define KEY_POOL_NAME  0x01
+#define KEY_POOL_VALUE 0x02
+
+// A running print of everything read from a file opened with
+// CONFIG_APPEND.
+// It's taken a word at a time, and the bytes of a word that
+// isn't full yet are kept until the next chunk, so the print
+// doesn't depend on how the file was split up.
+struct append_print
+{
+	uint64_t        print;
+	uint64_t        word;
+	unsigned int    fill;
+};
+
 // I'm using pointer to pointer for key_current so that we
 // can free items from the current position without working 
 // back down the list or doing extra assignements.
@@ -57,12 +152,65 @@ typedef struct k_list
 struct config
 {
 	int             fd;
+	int             flags;
 	size_t          block_size;
 	size_t	        buff_size;
 	char           *buff;
 	size_t          buff_pos;
 	k_list         *key_list;
 	k_list        **key_current;
+	k_list        **key_sorted;
+	size_t          key_count;
+	size_t          key_sorted_size;
+	int             key_indexed;
+	struct value_slot *value_slots;
+	size_t          value_mask;
+	const char    **values;
+	size_t          values_size;
+	int             values_built;
+	struct config_view view;
+	struct config_entry *entries;
+	size_t          entries_size;
+	int             view_built;
+	struct config_sub *subs;
+	struct config_sub **sub_slots;
+	size_t          sub_mask;
+	int             sub_firing;
+	struct config_snapshot *snapshot;
+	void           *packed;
+	size_t          packed_size;
+	k_list         *key_spare;
+	char            tag_value[2];
+	int             reading;
+	int             tok_state;
+	k_list         *key_build;
+	k_list        **key_tail;
+	size_t          max_bytes;
+	size_t          max_entries;
+	size_t          max_line;
+	size_t          max_value;
+	size_t          read_bytes;
+	size_t          read_entries;
+	size_t          read_line;
+	int             append_state;
+	off_t           append_read;
+	off_t           append_offset;
+	struct append_print append_run;
+	struct append_print append_mark;
+	k_list        **append_tail;
+	size_t          append_entries;
+	unsigned long   generation;
+	struct share_image *image;
+	size_t          image_pos;
+	_Atomic(struct override_map *) overrides;
+	atomic_uint     override_epoch;
+	atomic_uint     override_readers[2];
+	#ifndef NO_PTHREAD
+	pthread_mutex_t override_lock;
+	#endif
+	struct config_allocator alloc;
+	struct config_allocator alloc_self;
+	CONFIG_POOL    *pool;
 };
 
 /*
@@ -71,6 +219,14 @@ struct config
  * 			-Luna
  */
 
+// The snapshot cache needs to free CONFIGs before we get to
+// the functions for setting them up.
+static void config_free(CONFIG *restrict cfg);
+
+// Reads of files opened with CONFIG_APPEND are handed their
+// input before we get to the functions that keep track of it.
+static int append_feed(CONFIG *restrict cfg, const char *restrict data, size_t len);
+
 // We have a function to get a file's blocksize using fstat().
 // We use it to determine what buffer size to start with.
 static ssize_t get_block_size(int fd)
@@ -83,42 +239,311 @@ static ssize_t get_block_size(int fd)
 		return tmp.st_blksize;
 }
 
+// The tokenizer looks every character up here, so each test
+// is a single load and mask, rather than a chain of compares.
+static const unsigned char char_class[256] =
+{
+	[' ']  = CC_SPACE,
+	['\t'] = CC_SPACE,
+	['\r'] = CC_SPACE,
+	['\0'] = CC_NUL,
+	['\n'] = CC_NEWLINE,
+	['#']  = CC_HASH,
+	['=']  = CC_EQUALS
+};
+
+#define CHAR_IS(C, CLASS) (char_class[(unsigned char)(C)] & (CLASS))
+
 // Because space isn't the only whitespace character, we have
 // a function to test if a character is whitespace rather than
 // making our if() statements even harder to read.
 static int is_whitespace(char ctest)
 {
-	if(ctest == ' ' || ctest == '\t' || ctest == '\r')
-		return 1;
+	return CHAR_IS(ctest, CC_SPACE) != 0;
+}
+
+/*
+ * These are used when a CONFIG is opened with CONFIG_ICASE.
+ *
+ * We only fold ASCII, and do it ourselves rather than using
+ * strcasecmp(), so that the results don't depend on the locale
+ * and always agree with the stored hashes.
+ */
+static unsigned char fold_char(unsigned char c)
+{
+	if(c >= 'A' && c <= 'Z')
+		return c + ('a' - 'A');
 	else
+		return c;
+}
+
+// Compares strings in the same way as strcmp(), but ignores
+// case.
+static int fold_cmp(const char *restrict str1, const char *restrict str2)
+{
+	const unsigned char *s1 = (const unsigned char *)str1;
+	const unsigned char *s2 = (const unsigned char *)str2;
+
+	while(*s1 != '\0' && fold_char(*s1) == fold_char(*s2))
+	{
+		s1++;
+		s2++;
+	}
+
+	return fold_char(*s1) - fold_char(*s2);
+}
+
+// Compares at most 'len' characters in the same way as
+// strncmp(), but ignores case.
+static int fold_ncmp(const char *restrict str1, const char *restrict str2, size_t len)
+{
+	const unsigned char *s1 = (const unsigned char *)str1;
+	const unsigned char *s2 = (const unsigned char *)str2;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		if(fold_char(s1[i]) != fold_char(s2[i]))
+			return fold_char(s1[i]) - fold_char(s2[i]);
+		if(s1[i] == '\0')
+			break;
+	}
+
+	return 0;
+}
+
+// 32-bit FNV-1a over the folded string.
+static uint32_t fold_hash(const char *restrict str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		hash ^= fold_char(str[i]);
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// The same, but without folding, for when case matters.
+static uint32_t str_hash(const char *restrict str, size_t len)
+{
+	uint32_t hash = 2166136261u;
+
+	for(size_t i = 0; i < len; i++)
+	{
+		hash ^= (unsigned char)str[i];
+		hash *= 16777619u;
+	}
+
+	return hash;
+}
+
+// Tests if 'key' is the key we're searching for.
+// Every key carries its length, so most keys that don't match
+// are rejected without looking at the string.
+//
+// In case-folding mode, the hash of 'name' is worked out once
+// per search by the caller, and is checked first.
+static int key_match(const CONFIG *restrict cfg, const k_list *restrict key, const char *restrict name, size_t len, uint32_t hash)
+{
+	if(key->name_len != len)
+		return 0;
+
+	if(!(cfg->flags & CONFIG_ICASE))
+		return memcmp(key->name, name, len) == 0;
+
+	if(key->name_hash != hash)
 		return 0;
+
+	return fold_ncmp(key->name, name, len) == 0;
+}
+
+// Trims the value of a lazily read key in place.
+static void key_trim(k_list *restrict key)
+{
+	char *value = key->value;
+	size_t len = key->value_len;
+
+	for(; len > 0 && is_whitespace(*value); value++, len--);
+	for(; len > 0 && is_whitespace(value[len - 1]); len--);
+
+	value[len] = '\0';
+
+	key->value = value;
+	key->value_len = len;
+}
+
+// Trims the value of a lazily read key the first time it's
+// used.
+// This is a no-op for everything else, so it's safe to call
+// from any of the functions that hand out a key.
+static k_list *key_load(k_list *restrict key)
+{
+	if(key == NULL || key->loaded)
+		return key;
+
+	key_trim(key);
+	key->loaded = 1;
+
+	return key;
+}
+
+// The same, for the lookup functions, which may be called by
+// any number of threads at once.
+// The first thread to get to a key marks it as being loaded
+// while it trims the value, and any others wait for it, so the
+// value they see is always trimmed and terminated.
+#define KEY_LOADING 2
+
+static k_list *key_load_shared(k_list *restrict key)
+{
+	char state = __atomic_load_n(&key->loaded, __ATOMIC_ACQUIRE);
+
+	while(state != 1)
+	{
+		char expect = 0;
+
+		if(state == 0 && __atomic_compare_exchange_n(&key->loaded, &expect, KEY_LOADING, 0, __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE))
+		{
+			key_trim(key);
+			__atomic_store_n(&key->loaded, 1, __ATOMIC_RELEASE);
+			break;
+		}
+
+		#ifndef NO_PTHREAD
+		if(expect == KEY_LOADING || state == KEY_LOADING)
+			sched_yield();
+		#endif
+
+		state = __atomic_load_n(&key->loaded, __ATOMIC_ACQUIRE);
+	}
+
+	return key;
 }
 
-// I decided on this over using strcmp() becaue we only care
-// if the strings are identical or not.
+// These copy the name and value of a key out to the caller's
+// buffers for the non-by-reference functions.
 //
-// We don't need to waste time on comparing strings that don't
-// match.
-static int fast_cmp(const char *restrict str1, const char *restrict str2)
+// copy_value() returns 1, or the length of the uncopied data
+// + 1 if the value had to be truncated.
+static void copy_name(char *restrict name, const k_list *restrict key)
 {
-	for(int i = 0; str1[i] != '\0'; i++)
+	if(key->name_len > (CONFIG_MAX_KEY - 1))
 	{
-		if(str1[i] != str2[i])
-			return 0;
+		memcpy(name, key->name, (CONFIG_MAX_KEY - 1));
+		name[CONFIG_MAX_KEY - 1] = '\0';
+	}
+	else
+		memcpy(name, key->name, (key->name_len + 1));
+}
+
+static int copy_value(char *restrict data_buff, unsigned int buff_size, const k_list *restrict key)
+{
+	if(key->value_len > (buff_size - 1))
+	{
+		memcpy(data_buff, key->value, (buff_size - 1));
+		data_buff[buff_size - 1] = '\0';
+
+		return (key->value_len - (buff_size - 1)) + 1;
 	}
+	else
+		memcpy(data_buff, key->value, (key->value_len + 1));
 
 	return 1;
 }
 
+/*
+ * Here we start our static functions for allocating memory.
+ *
+ * All of our memory goes through an allocator, which is the
+ * standard one unless the program gives us its own with
+ * config_set_allocator().
+ * Allocators are told the size of everything they free, so we
+ * keep track of the size of everything we allocate.
+ */
+
+static void *std_alloc(size_t size, void *ctx)
+{
+	(void)ctx;
+	return malloc(size);
+}
+
+static void *std_resize(void *ptr, size_t old_size, size_t new_size, void *ctx)
+{
+	(void)old_size;
+	(void)ctx;
+	return realloc(ptr, new_size);
+}
+
+static void std_release(void *ptr, size_t size, void *ctx)
+{
+	(void)size;
+	(void)ctx;
+	free(ptr);
+}
+
+static const struct config_allocator std_allocator = {std_alloc, std_resize, std_release, NULL};
+
+// The allocator for new CONFIGs, and anything that doesn't
+// belong to one.
+static struct config_allocator default_allocator = {std_alloc, std_resize, std_release, NULL};
+
+// Allocators don't have to set errno, so we do it for them.
+static void *mem_alloc(const struct config_allocator *restrict alloc, size_t size)
+{
+	void *ptr = alloc->alloc(size, alloc->ctx);
+	if(ptr == NULL)
+		errno = ENOMEM;
+
+	return ptr;
+}
+
+static void *mem_zalloc(const struct config_allocator *restrict alloc, size_t size)
+{
+	void *ptr = mem_alloc(alloc, size);
+	if(ptr != NULL)
+		memset(ptr, 0, size);
+
+	return ptr;
+}
+
+// 'ptr' may be NULL, with an 'old_size' of 0.
+static void *mem_resize(const struct config_allocator *restrict alloc, void *ptr, size_t old_size, size_t new_size)
+{
+	if(ptr == NULL)
+		return mem_alloc(alloc, new_size);
+
+	void *tmp = alloc->resize(ptr, old_size, new_size, alloc->ctx);
+	if(tmp == NULL)
+		errno = ENOMEM;
+
+	return tmp;
+}
+
+static void mem_free(const struct config_allocator *restrict alloc, void *ptr, size_t size)
+{
+	if(ptr != NULL)
+		alloc->release(ptr, size, alloc->ctx);
+}
+
 // Here's our 'magic' signal blocking function.
 // Tt handles both setting and resetting the signal mask when-
 // ever we enter any of the public functions.
+//
+// Callbacks may call back into the library while we still
+// hold the mask, so we keep a depth count and only touch the
+// real mask on the outermost set and reset.
 static int set_sigmask(int state)
 {
-	static sigset_t old_mask;
+	static THREAD_LOCAL_ sigset_t old_mask;
+	static THREAD_LOCAL_ unsigned int depth = 0;
 	
 	if(state == SIGMASK_SET)
 	{
+		if(depth++ > 0)
+			return 1;
+
 		sigset_t new_mask;
 		if(sigemptyset(&new_mask) != 0)
 			return 0;
@@ -126,10 +551,16 @@ static int set_sigmask(int state)
 			return 0;
 
 		if(SIGPROCMASK_(SIG_BLOCK, &new_mask, &old_mask) != 0)
+		{
+			depth--;
 			return 0;
+		}
 	}
 	else if(state == SIGMASK_RST)
 	{
+		if(depth == 0 || --depth > 0)
+			return 1;
+
 		if(SIGPROCMASK_(SIG_SETMASK, &old_mask, NULL) != 0)
 		{
 			// If we fail to reset the mask we're kind of SOL.
@@ -146,912 +577,5929 @@ static int set_sigmask(int state)
 }
 
 /*
- * Here we start our static functions for allocating
- * handing, and freeing our linked-list.
+ * Here we start our static functions for intern pools.
+ *
+ * A pool holds one copy of each name and short value, shared
+ * by every key, in every CONFIG using the pool, that has the
+ * same string. Strings are counted, and freed when the last
+ * key using them is.
+ *
+ * Only keys that have been finished go into a pool, so a key
+ * still being read always has a buffer of its own.
  */
 
-// Adds a new entry *at the end* of a linked-list.
-static int list_add(k_list **restrict list)
+struct pool_str
 {
-	if(*list == NULL)
-	{
-		*list = malloc(sizeof(k_list));
-		if(*list == NULL)
-			return -1;
-		
-		(*list)->name = NULL;
-		(*list)->key_next = NULL;
-		
-		return 0;
-	}
+	struct pool_str *next;
+	size_t          refs;
+	size_t          len;
+	uint32_t        hash;
+	char            str[];
+};
 
-	k_list *current = *list;
-	
-	int count = 0;
+struct config_pool
+{
+	struct pool_str **table;
+	size_t          table_mask;
+	size_t          max_value;
+	size_t          users;
+	int             closed;
+	size_t          strings;
+	size_t          refs;
+	size_t          bytes;
+	size_t          copies;
+	#ifndef NO_PTHREAD
+	pthread_mutex_t lock;
+	#endif
+	struct config_allocator alloc;
+};
+
+static void pool_enter(CONFIG_POOL *restrict pool)
+{
+	#ifndef NO_PTHREAD
+	pthread_mutex_lock(&pool->lock);
+	#else
+	(void)pool;
+	#endif
+}
+
+static void pool_leave(CONFIG_POOL *restrict pool)
+{
+	#ifndef NO_PTHREAD
+	pthread_mutex_unlock(&pool->lock);
+	#else
+	(void)pool;
+	#endif
+}
+
+// Doubles the table of 'pool'.
+// The table works just as well too full, only slower, so a
+// failure here isn't passed on.
+static void pool_grow(CONFIG_POOL *restrict pool)
+{
+	size_t size = (pool->table_mask + 1) * 2;
+	struct pool_str **table = mem_zalloc(&pool->alloc, (size * sizeof(struct pool_str *)));
+	if(table == NULL)
+		return;
 
-	while(current->key_next != NULL)
+	for(size_t i = 0; i <= pool->table_mask; i++)
 	{
-		count++;
-		current = current->key_next;
-	}
+		struct pool_str *next;
 
-	current->key_next = malloc(sizeof(k_list));
-	if(current->key_next == NULL)
-		return -1;
-	
-	current = current->key_next;
-	current->name = NULL;
-	current->key_next = NULL;
+		for(struct pool_str *entry = pool->table[i]; entry != NULL; entry = next)
+		{
+			next = entry->next;
+			entry->next = table[entry->hash & (size - 1)];
+			table[entry->hash & (size - 1)] = entry;
+		}
+	}
 
-	return count;
+	mem_free(&pool->alloc, pool->table, ((pool->table_mask + 1) * sizeof(struct pool_str *)));
+	pool->bytes += (size - (pool->table_mask + 1)) * sizeof(struct pool_str *);
+	pool->table = table;
+	pool->table_mask = size - 1;
 }
 
-// This is the pimitive used to implement the index
-// functions.
-// It returns the n-1th element from the element passed
-// to it.
-static k_list *list_get(int index, k_list *restrict list)
+// Returns the pooled copy of 'str', adding it if it's new.
+// The pool must be locked.
+static char *pool_take(CONFIG_POOL *restrict pool, const char *restrict str, size_t len)
 {
-	if(list == NULL)
+	uint32_t hash = str_hash(str, len);
+	struct pool_str *entry;
+
+	for(entry = pool->table[hash & pool->table_mask]; entry != NULL; entry = entry->next)
 	{
-		errno = EINVAL;
-		return NULL;
+		if(entry->hash == hash && entry->len == len && memcmp(entry->str, str, len) == 0)
+			break;
 	}
-	
-	k_list *current = list;
 
-	for(int i=0;i<index;i++)
+	if(entry == NULL)
 	{
-		if(current->key_next == NULL)
-		{
-			errno = 0;
+		entry = mem_alloc(&pool->alloc, (sizeof(struct pool_str) + len + 1));
+		if(entry == NULL)
 			return NULL;
-		}
 
-		current = current->key_next;
+		if(pool->strings >= pool->table_mask + 1)
+			pool_grow(pool);
+
+		entry->refs = 0;
+		entry->len = len;
+		entry->hash = hash;
+		memcpy(entry->str, str, len);
+		entry->str[len] = '\0';
+
+		entry->next = pool->table[hash & pool->table_mask];
+		pool->table[hash & pool->table_mask] = entry;
+		pool->strings++;
+		pool->bytes += sizeof(struct pool_str) + len + 1;
 	}
 
-	return current;
+	entry->refs++;
+	pool->refs++;
+	pool->copies += len + 1;
+
+	return entry->str;
 }
 
-// Note that our function for freeing a list takes a 
-// pointer to pointer.
-// This lets us start in the middle of a list and set our
-// starting point to NULL in one step.
-static void list_free(k_list **restrict list)
+// Lets go of a string returned by pool_take().
+// The pool must be locked.
+static void pool_drop(CONFIG_POOL *restrict pool, char *restrict str)
 {
-	if(*list == NULL)
-		return;
+	struct pool_str *entry = (struct pool_str *)(str - offsetof(struct pool_str, str));
 
-	k_list *current = *list;
-	k_list *next = current->key_next;
+	pool->refs--;
+	pool->copies -= entry->len + 1;
 
-	while(current != NULL)
-	{
-		if(current->name != NULL)
-			free(current->name);
-		free(current);
-		current = NULL;
-		
-		current = next;
-		if(current != NULL)
-			next = current->key_next;
-	}
+	if(--entry->refs > 0)
+		return;
 
-	*list = NULL;	
+	struct pool_str **link = &pool->table[entry->hash & pool->table_mask];
+	for(; *link != entry; link = &(*link)->next);
+	*link = entry->next;
 
-	return;
+	pool->strings--;
+	pool->bytes -= sizeof(struct pool_str) + entry->len + 1;
+	mem_free(&pool->alloc, entry, (sizeof(struct pool_str) + entry->len + 1));
 }
 
-/*
- * Here we start our static functions for parsing our keys.
- */
-
-// This function gets the next item in 'buff' starting at 
-// '*position' and puts it into the 'name' value of a list item.
-// At this point, the item is a single string.
-static int get_next_key(k_list *restrict key_out, char *restrict buff, size_t *position)
+// Frees a pool once it's been closed, and nothing uses it.
+// Every string has been dropped by then, but we check anyway.
+static void pool_free(CONFIG_POOL *restrict pool)
 {
-	if(key_out == NULL || buff == NULL || position == NULL)
-	{
-		errno = EINVAL;
-		return -1;
-	}
+	struct config_allocator alloc = pool->alloc;
 
-	ssize_t start = -1;
-	ssize_t end = -1;
-    
-	while((start == -1 || buff[*position] != '\n') && buff[*position] != '\0')
+	for(size_t i = 0; i <= pool->table_mask; i++)
 	{
-		if(buff[*position] == '#')
-			for(;buff[*position] != '\n' && buff[*position] != '\0';(*position)++);
-		else if((start == -1 && !is_whitespace(buff[*position]) && buff[*position] != '\n'))
-		{
-			start = *position;
-			end = ++(*position);
-		}
-		else if(start == -1 && key_out->name != NULL)
+		struct pool_str *next;
+
+		for(struct pool_str *entry = pool->table[i]; entry != NULL; entry = next)
 		{
-		    start = 0;
-		    end = ++(*position);
+			next = entry->next;
+			mem_free(&alloc, entry, (sizeof(struct pool_str) + entry->len + 1));
 		}
-		else if(!is_whitespace(buff[*position]))
-			end = ++(*position);
-		else
-			(*position)++;
 	}
-	
-	if(buff[*position] == '\0')
-	    end = (*position);
-	
-	if(key_out->name == NULL && start != -1)
-	{
-		key_out->name = malloc(end - start + 1);
-		if(key_out->name == NULL)
-			return -1;
 
-		memcpy(key_out->name, (buff + start), (end - start));
-		key_out->name[end - start] = '\0';
-		
-		if(buff[*position] == '\n')
-			return 0;
-		else
-			return (end - start);
-	}
-	else if(start != -1)
-	{	
-		size_t old_len = strlen(key_out->name);
-		char *tmp = NULL;
+	mem_free(&alloc, pool->table, ((pool->table_mask + 1) * sizeof(struct pool_str *)));
+	#ifndef NO_PTHREAD
+	pthread_mutex_destroy(&pool->lock);
+	#endif
+	mem_free(&alloc, pool, sizeof(CONFIG_POOL));
+}
 
-		tmp = realloc(key_out->name, (old_len + (end - start + 1)));
-		if(tmp == NULL)
-			return -1;
+// Stops 'cfg' using its pool, freeing the pool if it's been
+// closed and 'cfg' was the last to use it.
+// None of the keys of 'cfg' may still be pooled.
+static void pool_detach(CONFIG *restrict cfg)
+{
+	CONFIG_POOL *pool = cfg->pool;
+	if(pool == NULL)
+		return;
 
-		key_out->name = tmp;
+	pool_enter(pool);
+	int last = (--pool->users == 0 && pool->closed);
+	pool_leave(pool);
 
-		memcpy((key_out->name + old_len), (buff + start), (end - start));
-		key_out->name[old_len + (end - start)] = '\0';
+	if(last)
+		pool_free(pool);
 
-		if(buff[*position] == '\n')
-			return 0;
-		else
-			return (end - start);
-	}
-	else
-		return -2;
+	cfg->pool = NULL;
 }
 
-// This function take the list item with a single string returned by 
-// get_next_key(), and parses it into two strings.
-//
-// Note that while we get two strings, we're still only using a 
-// single buffer.
-// This saves us doing extra allocations or copies.
-static int key_parse(k_list *restrict key)
+// Moves the name of a finished key, and its value if it's
+// short enough, into the pool of 'cfg', and gives back the
+// memory the key no longer needs.
+// Tags are always pooled, as their values are all the same.
+static int key_intern(CONFIG *restrict cfg, k_list *restrict key)
 {
-	if(key == NULL || key->name == NULL)
-	{
-		errno = EINVAL;
-		return -1;
-	}
+	CONFIG_POOL *pool = cfg->pool;
+	int tag = (key->value_len == 1 && key->value[0] == '\n');
+	char *value = NULL;
 
-	char is_empty = 0, is_key = 0;
-	size_t position;
-	       
-	ssize_t	start = -1, end;
+	pool_enter(pool);
 
-	for(position = 0; key->name[position] != '=' && key->name[position] != '\0'; position++)
+	char *name = pool_take(pool, key->name, key->name_len);
+	if(name != NULL && (tag || key->value_len <= pool->max_value))
 	{
-		if(!is_whitespace(key->name[position]) && start == -1)
+		value = pool_take(pool, key->value, key->value_len);
+		if(value == NULL)
 		{
-			start = position;
-			end = position + 1;
+			pool_drop(pool, name);
+			name = NULL;
 		}
-		else if(!is_whitespace(key->name[position]))
-			end = position + 1;
-	}
-	
-	if(key->name[position] == '=')
-	{
-		is_key = 1;
-		key->name[position] = ' ';
 	}
 
-	if(start > 0)
+	pool_leave(pool);
+
+	if(name == NULL)
+		return -1;
+
+	if(value != NULL)
 	{
-		memmove(key->name, (key->name + start), (end - start));
-		key->name[end - start] = '\0';
+		mem_free(&cfg->alloc, key->name, key->name_size);
+		key->name_size = 0;
+		key->pooled = (KEY_POOL_NAME | KEY_POOL_VALUE);
 	}
 	else
-		key->name[end - start] = '\0';
+	{
+		// Only the value is left in the buffer, so it's moved to
+		// the front, and the rest given back.
+		// If that fails, we just keep the rest.
+		value = key->name;
+		memmove(value, key->value, (key->value_len + 1));
 
-	key->value = (key->name + (end - start + 1));
+		int err = errno;
+		char *tmp = mem_resize(&cfg->alloc, value, key->name_size, (key->value_len + 1));
+		errno = err;
 
-	start = -1;
+		if(tmp != NULL)
+		{
+			value = tmp;
+			key->name_size = key->value_len + 1;
+		}
+
+		key->pooled = KEY_POOL_NAME;
+	}
+
+	key->name = name;
+	key->value = value;
+
+	return 0;
+}
+
+// Gives the strings of a pooled key back to the pool, leaving
+// the key as it would be without one; owning a buffer at
+// 'name', or nothing at all.
+static void key_unpool(CONFIG *restrict cfg, k_list *restrict key)
+{
+	pool_enter(cfg->pool);
+
+	pool_drop(cfg->pool, key->name);
+	if(key->pooled & KEY_POOL_VALUE)
+	{
+		pool_drop(cfg->pool, key->value);
+		key->name = NULL;
+	}
+	else
+		key->name = key->value;
+
+	pool_leave(cfg->pool);
+
+	key->pooled = 0;
+}
+
+/*
+ * Here we start our static functions for allocating
+ * handing, and freeing our linked-list.
+ */
+
+// Adds a new entry *at the end* of the keylist being read.
+// We keep a pointer to the last link, so this never has to
+// walk the list.
+static void list_add(CONFIG *restrict cfg, k_list *restrict key)
+{
+	key->key_next = NULL;
+
+	*cfg->key_tail = key;
+	cfg->key_tail = &key->key_next;
+}
+
+// Gets a key for the list being read.
+// Keys from the last read are kept, along with their buffers,
+// so reading a file again usually doesn't need to allocate
+// anything.
+static k_list *list_take(CONFIG *restrict cfg)
+{
+	k_list *key = cfg->key_spare;
+
+	if(key != NULL)
+	{
+		cfg->key_spare = key->key_next;
+
+		if(key->pooled)
+			key_unpool(cfg, key);
+	}
+	else
+	{
+		key = mem_alloc(&cfg->alloc, sizeof(k_list));
+		if(key == NULL)
+			return NULL;
+
+		key->name = NULL;
+		key->name_size = 0;
+		key->pooled = 0;
+	}
+
+	key->name_len = 0;
+	key->key_next = NULL;
+
+	return key;
+}
+
+// This is the pimitive used to implement the index
+// functions.
+// It returns the n-1th element from the element passed
+// to it.
+static k_list *list_get(int index, k_list *restrict list)
+{
+	if(list == NULL)
+	{
+		errno = EINVAL;
+		return NULL;
+	}
+	
+	k_list *current = list;
+
+	for(int i=0;i<index;i++)
+	{
+		if(current->key_next == NULL)
+		{
+			errno = 0;
+			return NULL;
+		}
+
+		current = current->key_next;
+	}
+
+	return current;
+}
+
+// Note that our function for freeing a list takes a 
+// pointer to pointer.
+// This lets us start in the middle of a list and set our
+// starting point to NULL in one step.
+//
+// In lazy mode the names point into the read buffer, so we
+// only free the ones that have a size of their own.
+static void list_free(CONFIG *restrict cfg, k_list **restrict list)
+{
+	if(*list == NULL)
+		return;
+
+	k_list *current = *list;
+	k_list *next = current->key_next;
+
+	while(current != NULL)
+	{
+		if(current->pooled)
+			key_unpool(cfg, current);
+		if(current->name_size > 0)
+			mem_free(&cfg->alloc, current->name, current->name_size);
+		mem_free(&cfg->alloc, current, sizeof(k_list));
+		current = NULL;
+		
+		current = next;
+		if(current != NULL)
+			next = current->key_next;
+	}
+
+	*list = NULL;	
+
+	return;
+}
+
+/*
+ * Here we start our static functions for the sorted key
+ * index used by the prefix and range functions.
+ */
+
+// A plain bottom-up merge sort.
+// We can't use qsort() here, as keys that share a name need
+// to stay in the order they were read from the file.
+//
+// 'tmp' must have room for 'count' keys.
+static void index_sort(k_list **restrict keys, k_list **restrict tmp, size_t count, int (*cmp)(const char *, const char *))
+{
+	k_list **src = keys;
+	k_list **dst = tmp;
+
+	for(size_t width = 1; width < count; width *= 2)
+	{
+		for(size_t lo = 0; lo < count; lo += 2 * width)
+		{
+			size_t mid = (lo + width < count) ? lo + width : count;
+			size_t hi = (lo + 2 * width < count) ? lo + 2 * width : count;
+			size_t i = lo, j = mid, k = lo;
+
+			while(i < mid && j < hi)
+			{
+				if(cmp(src[j]->name, src[i]->name) < 0)
+					dst[k++] = src[j++];
+				else
+					dst[k++] = src[i++];
+			}
+			while(i < mid)
+				dst[k++] = src[i++];
+			while(j < hi)
+				dst[k++] = src[j++];
+		}
+
+		k_list **swap = src;
+		src = dst;
+		dst = swap;
+	}
+
+	if(src != keys)
+		memcpy(keys, src, count * sizeof(k_list *));
+}
+
+// Builds the sorted index for a keylist.
+// This is done the first time the index is needed, rather
+// than by config_read(), so nobody pays for it unless they
+// use it.
+//
+// The array has room for twice the keys, as the second half
+// is used by the sort. It's kept when the keylist is read
+// again, and only grows if it has to.
+static int index_build(CONFIG *restrict cfg)
+{
+	size_t count = 0;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+		count++;
+
+	if(count > cfg->key_sorted_size)
+	{
+		k_list **tmp = mem_resize(&cfg->alloc, cfg->key_sorted, (cfg->key_sorted_size * 2 * sizeof(k_list *)), (count * 2 * sizeof(k_list *)));
+		if(tmp == NULL)
+			return -1;
+
+		cfg->key_sorted = tmp;
+		cfg->key_sorted_size = count;
+	}
+
+	count = 0;
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+		cfg->key_sorted[count++] = current;
+
+	index_sort(cfg->key_sorted, (cfg->key_sorted + count), count, (cfg->flags & CONFIG_ICASE) ? fold_cmp : strcmp);
+
+	cfg->key_count = count;
+	cfg->key_indexed = 1;
+
+	return 0;
+}
+
+// Marks the index, and the occurrence lists, out of date.
+static void index_free(CONFIG *restrict cfg)
+{
+	cfg->key_count = 0;
+	cfg->key_indexed = 0;
+	cfg->values_built = 0;
+	cfg->view_built = 0;
+}
+
+// Returns the position of the first key in the index that
+// doesn't sort before 'name'.
+static size_t index_lower(CONFIG *restrict cfg, const char *restrict name)
+{
+	int (*cmp)(const char *, const char *) = (cfg->flags & CONFIG_ICASE) ? fold_cmp : strcmp;
+	size_t lo = 0, hi = cfg->key_count;
+
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+
+		if(cmp(cfg->key_sorted[mid]->name, name) < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return lo;
+}
+
+/*
+ * Here we start our static functions for the occurrence lists
+ * used by config_values().
+ *
+ * The values of every key are gathered into one array, with
+ * the values of keys that share a name next to each other, in
+ * the order they were read.
+ * A hash table gives the run of values for each name, so
+ * finding them all costs no more than finding the first.
+ *
+ * Like the index, it's built the first time it's needed after
+ * a read, and its memory is kept for the next one.
+ */
+
+struct value_slot
+{
+	const k_list   *key;
+	uint32_t        hash;
+	size_t          start;
+	size_t          count;
+};
+
+static uint32_t value_hash(const CONFIG *restrict cfg, const k_list *restrict key)
+{
+	if(cfg->flags & CONFIG_ICASE)
+		return key->name_hash;
+	else
+		return str_hash(key->name, key->name_len);
+}
+
+// Returns the slot for 'name', or the empty slot where it
+// belongs.
+static struct value_slot *value_slot(const CONFIG *restrict cfg, const char *restrict name, size_t len, uint32_t hash)
+{
+	size_t i = hash & cfg->value_mask;
+
+	while(cfg->value_slots[i].key != NULL)
+	{
+		struct value_slot *slot = &cfg->value_slots[i];
+
+		if(slot->hash == hash && key_match(cfg, slot->key, name, len, hash))
+			break;
+
+		i = (i + 1) & cfg->value_mask;
+	}
+
+	return &cfg->value_slots[i];
+}
+
+static int values_build(CONFIG *restrict cfg)
+{
+	size_t count = 0;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+		count++;
+
+	if(count > cfg->values_size)
+	{
+		const char **tmp = mem_resize(&cfg->alloc, cfg->values, (cfg->values_size * sizeof(char *)), (count * sizeof(char *)));
+		if(tmp == NULL)
+			return -1;
+
+		cfg->values = tmp;
+		cfg->values_size = count;
+	}
+
+	// The table is kept at most half full.
+	size_t size = 8;
+	while(size < count * 2)
+		size *= 2;
+
+	if(cfg->value_slots == NULL || size > cfg->value_mask + 1)
+	{
+		struct value_slot *tmp = mem_alloc(&cfg->alloc, (size * sizeof(struct value_slot)));
+		if(tmp == NULL)
+			return -1;
+
+		if(cfg->value_slots != NULL)
+			mem_free(&cfg->alloc, cfg->value_slots, ((cfg->value_mask + 1) * sizeof(struct value_slot)));
+
+		cfg->value_slots = tmp;
+		cfg->value_mask = size - 1;
+	}
+
+	memset(cfg->value_slots, 0, ((cfg->value_mask + 1) * sizeof(struct value_slot)));
+
+	// First we count the keys with each name...
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+	{
+		uint32_t hash = value_hash(cfg, current);
+		struct value_slot *slot = value_slot(cfg, current->name, current->name_len, hash);
+
+		if(slot->key == NULL)
+		{
+			slot->key = current;
+			slot->hash = hash;
+		}
+
+		slot->count++;
+	}
+
+	// ...then give each name its run of the array...
+	size_t start = 0;
+	for(size_t i = 0; i <= cfg->value_mask; i++)
+	{
+		cfg->value_slots[i].start = start;
+		start += cfg->value_slots[i].count;
+	}
+
+	// ...and fill them in, using 'start' to keep our place.
+	// In lazy mode this is where the values get trimmed.
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+	{
+		struct value_slot *slot = value_slot(cfg, current->name, current->name_len, value_hash(cfg, current));
+
+		cfg->values[slot->start++] = key_load(current)->value;
+	}
+
+	for(size_t i = 0; i <= cfg->value_mask; i++)
+		cfg->value_slots[i].start -= cfg->value_slots[i].count;
+
+	cfg->values_built = 1;
+
+	return 0;
+}
+
+// Lays the keylist out as an array for config_view().
+static int view_build(CONFIG *restrict cfg)
+{
+	size_t count = 0;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+		count++;
+
+	if(count > cfg->entries_size)
+	{
+		struct config_entry *tmp = mem_resize(&cfg->alloc, cfg->entries, (cfg->entries_size * sizeof(struct config_entry)), (count * sizeof(struct config_entry)));
+		if(tmp == NULL)
+			return -1;
+
+		cfg->entries = tmp;
+		cfg->entries_size = count;
+	}
+
+	count = 0;
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next, count++)
+	{
+		key_load(current);
+
+		cfg->entries[count].name.ptr = current->name;
+		cfg->entries[count].name.len = current->name_len;
+		cfg->entries[count].value.ptr = current->value;
+		cfg->entries[count].value.len = current->value_len;
+	}
+
+	cfg->view.count = count;
+	cfg->view.entries = cfg->entries;
+	cfg->view_built = 1;
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for enforcing the limits
+ * set by config_set_limits().
+ *
+ * Every one of them fails with EFBIG, which nothing else in a
+ * read can, so callers can tell a file that broke its limits
+ * from one that couldn't be read.
+ * A limit of 0 is no limit at all.
+ */
+
+// Counts a chunk of input against the size and line limits,
+// before any of it is parsed.
+static int limit_input(CONFIG *restrict cfg, const char *restrict data, size_t len)
+{
+	if(cfg->max_bytes > 0)
+	{
+		if(len > cfg->max_bytes - cfg->read_bytes)
+		{
+			errno = EFBIG;
+			return -1;
+		}
+
+		cfg->read_bytes += len;
+	}
+
+	if(cfg->max_line > 0)
+	{
+		const char *end = data + len;
+
+		for(const char *pos = data; pos < end;)
+		{
+			const char *newline = memchr(pos, '\n', (end - pos));
+			size_t span = ((newline != NULL) ? newline : end) - pos;
+
+			if(span > cfg->max_line - cfg->read_line)
+			{
+				errno = EFBIG;
+				return -1;
+			}
+
+			if(newline == NULL)
+			{
+				cfg->read_line += span;
+				break;
+			}
+
+			cfg->read_line = 0;
+			pos = newline + 1;
+		}
+	}
+
+	return 0;
+}
+
+// Counts one more key against the limit on entries, before
+// it's allocated.
+// Keys are counted even with no limit, as a read that only
+// picks up the end of a file needs to know how many it kept.
+static int limit_entry(CONFIG *restrict cfg)
+{
+	if(cfg->read_entries++ >= cfg->max_entries && cfg->max_entries > 0)
+	{
+		errno = EFBIG;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Checks that a value of 'len' bytes is within its limit.
+// This is the raw value, so blanks at its end count.
+static int limit_value(const CONFIG *restrict cfg, size_t len)
+{
+	if(cfg->max_value > 0 && len > cfg->max_value)
+	{
+		errno = EFBIG;
+		return -1;
+	}
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for parsing our keys.
+ */
+
+// Makes sure the buffer of 'key' holds at least 'need'
+// bytes, keeping what's already in it.
+// Buffers grow by doubling, so a long line split over many
+// chunks is still copied a bounded number of times.
+static int key_reserve(CONFIG *restrict cfg, k_list *restrict key, size_t need)
+{
+	if(need <= key->name_size)
+		return 0;
+
+	size_t size = (key->name_size > 0) ? key->name_size : 32;
+
+	while(size < need)
+		size *= 2;
+
+	char *tmp = mem_resize(&cfg->alloc, key->name, key->name_size, size);
+	if(tmp == NULL)
+		return -1;
+
+	key->name = tmp;
+	key->name_size = size;
+
+	return 0;
+}
+
+// Copies 'len' bytes of a line to 'offset' in the buffer of
+// 'key'.
+// Any NULs in the file are treated as spaces.
+static int key_write(CONFIG *restrict cfg, k_list *restrict key, size_t offset, const char *restrict data, size_t len)
+{
+	if(key_reserve(cfg, key, (offset + len + 1)) == -1)
+		return -1;
+
+	char *dest = key->name + offset;
+	memcpy(dest, data, len);
+	for(char *nul = memchr(dest, '\0', len); nul != NULL; nul = memchr(nul, '\0', (dest + len) - nul))
+		*nul = ' ';
+
+	return 0;
+}
+
+// Finishes the key being read once we reach the end of its
+// line.
+//
+// The tokenizer has already put the name and value where they
+// belong, in a single buffer, as "name\0value\0", so all that's
+// left is trimming the end of the value, or the name if there
+// was no '=' on the line.
+// Items that aren't keys get a value of "\n".
+static int key_finish(CONFIG *restrict cfg)
+{
+	k_list *key = cfg->key_build;
+
+	if(cfg->tok_state == TOK_NAME)
+	{
+		for(; key->name_len > 0 && is_whitespace(key->name[key->name_len - 1]); key->name_len--);
+
+		if(key_reserve(cfg, key, (key->name_len + 3)) == -1)
+			return -1;
+
+		key->name[key->name_len] = '\0';
+		key->value = (key->name + key->name_len + 1);
+		key->value[0] = '\n';
+		key->value[1] = '\0';
+		key->value_len = 1;
+	}
+	else
+	{
+		if(key_reserve(cfg, key, (key->name_len + key->value_len + 2)) == -1)
+			return -1;
+
+		key->value = (key->name + key->name_len + 1);
+		for(; key->value_len > 0 && is_whitespace(key->value[key->value_len - 1]); key->value_len--);
+		key->value[key->value_len] = '\0';
+	}
+
+	key->loaded = 1;
+
+	// In case-folding mode we store the folded hash of every
+	// name now, so searching doesn't need to fold every key
+	// it passes.
+	if(cfg->flags & CONFIG_ICASE)
+		key->name_hash = fold_hash(key->name, key->name_len);
+
+	if(cfg->pool != NULL && key_intern(cfg, key) == -1)
+		return -1;
+
+	list_add(cfg, key);
+	cfg->key_build = NULL;
+
+	return 0;
+}
+
+// This is our tokenizer.
+// It takes the input a chunk at a time, and remembers where it
+// was in 'cfg->tok_state', so it doesn't matter where a chunk
+// ends; in the middle of a name, a value, a comment, or between
+// lines.
+//
+// Names and values are found in a single forward pass, and
+// each is written straight to its place in the key's buffer,
+// so nothing is scanned twice or moved afterwards.
+// The only bytes we look at again are trailing whitespace,
+// when it's trimmed.
+static int tok_feed(CONFIG *restrict cfg, const char *restrict buff, size_t len)
+{
+	size_t position = 0;
+
+	while(position < len)
+	{
+		k_list *key = cfg->key_build;
+
+		if(cfg->tok_state == TOK_START)
+		{
+			for(; position < len && CHAR_IS(buff[position], (CC_SPACE | CC_NUL | CC_NEWLINE)); position++);
+
+			if(position == len)
+				break;
+
+			if(buff[position] == '#')
+			{
+				cfg->tok_state = TOK_COMMENT;
+				continue;
+			}
+
+			// The key isn't added to the keylist until its line
+			// is finished, so a partly read file never shows a
+			// partly read key.
+			if(limit_entry(cfg) == -1)
+				return -1;
+
+			cfg->key_build = list_take(cfg);
+			if(cfg->key_build == NULL)
+				return -1;
+
+			cfg->key_build->value_len = 0;
+			cfg->tok_state = TOK_NAME;
+		}
+		else if(cfg->tok_state == TOK_NAME)
+		{
+			size_t start = position;
+
+			for(; position < len && !CHAR_IS(buff[position], (CC_EQUALS | CC_HASH | CC_NEWLINE)); position++);
+
+			if(position > start)
+			{
+				if(key_write(cfg, key, key->name_len, (buff + start), (position - start)) == -1)
+					return -1;
+
+				key->name_len += position - start;
+			}
+
+			if(position == len)
+				break;
+
+			if(buff[position] == '=')
+			{
+				// The value goes straight after the trimmed name,
+				// over any whitespace that came before the '='.
+				for(; key->name_len > 0 && is_whitespace(key->name[key->name_len - 1]); key->name_len--);
+
+				if(key_reserve(cfg, key, (key->name_len + 1)) == -1)
+					return -1;
+
+				key->name[key->name_len] = '\0';
+				cfg->tok_state = TOK_SPACE;
+				position++;
+				continue;
+			}
+
+			if(key_finish(cfg) == -1)
+				return -1;
+
+			cfg->tok_state = (buff[position] == '#') ? TOK_COMMENT : TOK_START;
+			position++;
+		}
+		else if(cfg->tok_state == TOK_SPACE)
+		{
+			for(; position < len && CHAR_IS(buff[position], (CC_SPACE | CC_NUL)); position++);
+
+			if(position < len)
+				cfg->tok_state = TOK_VALUE;
+		}
+		else if(cfg->tok_state == TOK_VALUE)
+		{
+			// Values may be very long, so we find their end with
+			// memchr() rather than a byte at a time.
+			size_t start = position;
+			const char *end = memchr((buff + position), '\n', (len - position));
+			const char *hash = memchr((buff + position), '#', (((end != NULL) ? (size_t)(end - buff) : len) - position));
+
+			if(hash != NULL)
+				position = hash - buff;
+			else if(end != NULL)
+				position = end - buff;
+			else
+				position = len;
+
+			if(position > start)
+			{
+				if(limit_value(cfg, (key->value_len + (position - start))) == -1)
+					return -1;
+
+				if(key_write(cfg, key, (key->name_len + 1 + key->value_len), (buff + start), (position - start)) == -1)
+					return -1;
+
+				key->value_len += position - start;
+			}
+
+			if(position == len)
+				break;
+
+			if(key_finish(cfg) == -1)
+				return -1;
+
+			cfg->tok_state = (buff[position] == '#') ? TOK_COMMENT : TOK_START;
+			position++;
+		}
+		else
+		{
+			const char *end = memchr((buff + position), '\n', (len - position));
+			if(end == NULL)
+				break;
+
+			position = (end - buff) + 1;
+			cfg->tok_state = TOK_START;
+		}
+	}
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for lazy reading.
+ *
+ * When a CONFIG is opened with CONFIG_LAZY, config_read()
+ * keeps the whole file in 'buff' and makes a single pass over
+ * it, recording only the name and the raw span of the value
+ * on each line.
+ * Values are trimmed in place the first time they're used.
+ */
+
+// Makes sure there's room for at least 'extra' more bytes
+// (and a terminator) after 'buff_pos' in 'buff', doubling the
+// buffer as needed.
+static int buff_reserve(CONFIG *restrict cfg, size_t extra)
+{
+	if(cfg->buff != NULL && cfg->buff_size - cfg->buff_pos >= extra)
+		return 0;
+
+	size_t capacity = (cfg->buff != NULL) ? cfg->buff_size : 0;
+
+	if(capacity < cfg->block_size)
+		capacity = cfg->block_size;
+
+	#ifndef NO_MIN_BUFF
+	if(capacity < BUFF_MIN)
+		capacity = BUFF_MIN;
+	#endif
+
+	while(capacity - cfg->buff_pos < extra)
+		capacity *= 2;
+
+	char *tmp = mem_resize(&cfg->alloc, cfg->buff, ((cfg->buff != NULL) ? cfg->buff_size + 1 : 0), (capacity + 1));
+	if(tmp == NULL)
+		return -1;
+
+	cfg->buff = tmp;
+	cfg->buff_size = capacity;
+
+	return 0;
+}
+
+// Splits 'cfg->buff' into keys, following the same rules as
+// tok_feed() and key_finish().
+//
+// Names are terminated in place, which is always safe, as the
+// byte after a name is whitespace, '=', '#', or the end of the
+// line, and we've already noted which one it was.
+static int lazy_scan(CONFIG *restrict cfg)
+{
+	char *pos = cfg->buff;
+	char *buff_end = cfg->buff + cfg->buff_pos;
+
+	for(char *nul = memchr(pos, '\0', cfg->buff_pos); nul != NULL; nul = memchr(nul, '\0', (buff_end - nul)))
+		*nul = ' ';
+
+	*buff_end = '\0';
+
+	cfg->tag_value[0] = '\n';
+	cfg->tag_value[1] = '\0';
+
+	while(pos < buff_end)
+	{
+		char *start, *end, *equals;
+
+		for(; is_whitespace(*pos); pos++);
+
+		// As in tok_feed(), we leave the long lines to memchr().
+		start = pos;
+		end = memchr(start, '\n', (buff_end - start));
+		if(end == NULL)
+			end = buff_end;
+
+		pos = (end < buff_end) ? end + 1 : end;
+
+		char *hash = memchr(start, '#', (end - start));
+		if(hash != NULL)
+			end = hash;
+
+		if(start == end)
+			continue;
+
+		equals = memchr(start, '=', (end - start));
+
+		if(limit_entry(cfg) == -1)
+			return -1;
+
+		if(equals != NULL && cfg->max_value > 0)
+		{
+			char *value = equals + 1;
+			for(; value < end && is_whitespace(*value); value++);
+
+			if(limit_value(cfg, (end - value)) == -1)
+				return -1;
+		}
+
+		k_list *key = list_take(cfg);
+		if(key == NULL)
+			return -1;
+
+		if(key->name_size > 0)
+		{
+			mem_free(&cfg->alloc, key->name, key->name_size);
+			key->name_size = 0;
+		}
+
+		list_add(cfg, key);
+
+		char *name_end = (equals != NULL) ? equals : end;
+		for(; name_end > start && is_whitespace(name_end[-1]); name_end--);
+
+		key->name = start;
+		key->name_len = name_end - start;
+
+		if(equals != NULL)
+		{
+			key->value = equals + 1;
+			key->value_len = end - (equals + 1);
+			key->loaded = 0;
+		}
+		else
+		{
+			key->value = cfg->tag_value;
+			key->value_len = 1;
+			key->loaded = 1;
+		}
+
+		*name_end = '\0';
+
+		if(cfg->flags & CONFIG_ICASE)
+			key->name_hash = fold_hash(key->name, key->name_len);
+	}
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for change subscriptions.
+ *
+ * Rather than keeping a copy of the old keylist to compare
+ * against, each subscription keeps a fingerprint of the items
+ * it covers; a 64-bit FNV-1a hash of their blocks, names, and
+ * values, in order, along with how many there were.
+ * When a read finishes, one pass over the new keylist works
+ * out the new fingerprint of every subscription, and only
+ * those that differ are called.
+ *
+ * A subscription to a tag (such as "[section]") also covers
+ * every key after it, up to the next tag.
+ */
+
+struct config_sub
+{
+	struct config_sub *next;
+	struct config_sub *same_next;
+	config_change_fn   callback;
+	void              *arg;
+	uint32_t           hash;
+	size_t             name_len;
+	uint64_t           print;
+	size_t             count;
+	uint64_t           new_print;
+	size_t             new_count;
+	const k_list      *first;
+	char               name[];
+};
+
+#define PRINT_BASIS 14695981039346656037u
+#define PRINT_PRIME 1099511628211u
+
+static uint32_t sub_hash(const CONFIG *restrict cfg, const char *restrict name, size_t len)
+{
+	if(cfg->flags & CONFIG_ICASE)
+		return fold_hash(name, len);
+	else
+		return str_hash(name, len);
+}
+
+// Adds a string to a fingerprint.
+// Its length goes in after it, so "ab" + "c" and "a" + "bc"
+// come out differently.
+static uint64_t print_mix(uint64_t print, const char *restrict str, size_t len, int fold)
+{
+	for(size_t i = 0; i < len; i++)
+	{
+		print ^= fold ? fold_char(str[i]) : (unsigned char)str[i];
+		print *= PRINT_PRIME;
+	}
+
+	print ^= len;
+	print *= PRINT_PRIME;
+
+	return print;
+}
+
+// Returns the first subscription to 'name', or the empty slot
+// where it belongs.
+static struct config_sub **sub_slot(const CONFIG *restrict cfg, const char *restrict name, size_t len, uint32_t hash)
+{
+	size_t i = hash & cfg->sub_mask;
+
+	while(cfg->sub_slots[i] != NULL)
+	{
+		const struct config_sub *sub = cfg->sub_slots[i];
+
+		if(sub->hash == hash && sub->name_len == len)
+		{
+			if((cfg->flags & CONFIG_ICASE) ? fold_ncmp(sub->name, name, len) == 0 : memcmp(sub->name, name, len) == 0)
+				break;
+		}
+
+		i = (i + 1) & cfg->sub_mask;
+	}
+
+	return &cfg->sub_slots[i];
+}
+
+static struct config_sub *sub_find(const CONFIG *restrict cfg, const k_list *restrict key)
+{
+	uint32_t hash = (cfg->flags & CONFIG_ICASE) ? key->name_hash : str_hash(key->name, key->name_len);
+
+	return *sub_slot(cfg, key->name, key->name_len, hash);
+}
+
+// Rebuilds the table of names from the list of subscriptions.
+// Subscriptions to the same name are chained in the order
+// they were made.
+//
+// The table only grows, so this can't fail when subscriptions
+// have been taken away.
+static int sub_table(CONFIG *restrict cfg)
+{
+	size_t count = 0;
+
+	for(struct config_sub *sub = cfg->subs; sub != NULL; sub = sub->next)
+		count++;
+
+	size_t size = 8;
+	while(size < count * 2)
+		size *= 2;
+
+	if(cfg->sub_slots == NULL || size > cfg->sub_mask + 1)
+	{
+		struct config_sub **slots = mem_alloc(&cfg->alloc, (size * sizeof(struct config_sub *)));
+		if(slots == NULL)
+			return -1;
+
+		if(cfg->sub_slots != NULL)
+			mem_free(&cfg->alloc, cfg->sub_slots, ((cfg->sub_mask + 1) * sizeof(struct config_sub *)));
+
+		cfg->sub_slots = slots;
+		cfg->sub_mask = size - 1;
+	}
+
+	memset(cfg->sub_slots, 0, ((cfg->sub_mask + 1) * sizeof(struct config_sub *)));
+
+	for(struct config_sub *sub = cfg->subs; sub != NULL; sub = sub->next)
+	{
+		struct config_sub **link = sub_slot(cfg, sub->name, sub->name_len, sub->hash);
+
+		for(; *link != NULL; link = &(*link)->same_next);
+
+		sub->same_next = NULL;
+		*link = sub;
+	}
+
+	return 0;
+}
+
+static void sub_mix(CONFIG *restrict cfg, struct config_sub *restrict chain, const k_list *restrict block, k_list *restrict key)
+{
+	int fold = (cfg->flags & CONFIG_ICASE) != 0;
+
+	key_load(key);
+
+	for(struct config_sub *sub = chain; sub != NULL; sub = sub->same_next)
+	{
+		uint64_t print = sub->new_print;
+
+		if(block != NULL)
+			print = print_mix(print, block->name, block->name_len, fold);
+		print = print_mix(print, key->name, key->name_len, fold);
+		print = print_mix(print, key->value, key->value_len, 0);
+
+		sub->new_print = print;
+		sub->new_count++;
+		if(sub->first == NULL)
+			sub->first = key;
+	}
+}
+
+// Works out the new fingerprint of every subscription.
+static void sub_scan(CONFIG *restrict cfg)
+{
+	for(struct config_sub *sub = cfg->subs; sub != NULL; sub = sub->next)
+	{
+		sub->new_print = PRINT_BASIS;
+		sub->new_count = 0;
+		sub->first = NULL;
+	}
+
+	const k_list *block = NULL;
+	struct config_sub *block_subs = NULL;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+	{
+		struct config_sub *chain = sub_find(cfg, current);
+
+		// Values never hold a newline, so this is only true of
+		// tags, even if the value hasn't been trimmed yet.
+		if(current->value_len == 1 && current->value[0] == '\n')
+		{
+			block = current;
+			block_subs = chain;
+		}
+		else if(block_subs != NULL)
+			sub_mix(cfg, block_subs, NULL, current);
+
+		if(chain != NULL)
+			sub_mix(cfg, chain, block, current);
+	}
+}
+
+// Frees the subscriptions dropped by config_unsubscribe()
+// while they were being called.
+static void sub_sweep(CONFIG *restrict cfg)
+{
+	struct config_sub **link = &cfg->subs;
+	int dropped = 0;
+
+	while(*link != NULL)
+	{
+		struct config_sub *sub = *link;
+
+		if(sub->callback == NULL)
+		{
+			*link = sub->next;
+			mem_free(&cfg->alloc, sub, (sizeof(struct config_sub) + sub->name_len + 1));
+			dropped = 1;
+		}
+		else
+			link = &sub->next;
+	}
+
+	if(dropped)
+		sub_table(cfg);
+}
+
+// Calls the subscriptions whose items changed in the read
+// that just finished.
+static void sub_notify(CONFIG *restrict cfg)
+{
+	if(cfg->subs == NULL)
+		return;
+
+	sub_scan(cfg);
+
+	cfg->sub_firing++;
+
+	for(struct config_sub *sub = cfg->subs; sub != NULL; sub = sub->next)
+	{
+		int change = 0;
+
+		if(sub->count == 0 && sub->new_count > 0)
+			change = CONFIG_CHANGE_ADDED;
+		else if(sub->count > 0 && sub->new_count == 0)
+			change = CONFIG_CHANGE_REMOVED;
+		else if(sub->count != sub->new_count || sub->print != sub->new_print)
+			change = CONFIG_CHANGE_MODIFIED;
+
+		sub->print = sub->new_print;
+		sub->count = sub->new_count;
+
+		if(change != 0 && sub->callback != NULL)
+			sub->callback(change, sub->name, ((sub->first != NULL) ? sub->first->value : NULL), sub->arg);
+	}
+
+	if(--cfg->sub_firing == 0)
+		sub_sweep(cfg);
+}
+
+static void sub_free(CONFIG *restrict cfg)
+{
+	while(cfg->subs != NULL)
+	{
+		struct config_sub *sub = cfg->subs;
+
+		cfg->subs = sub->next;
+		mem_free(&cfg->alloc, sub, (sizeof(struct config_sub) + sub->name_len + 1));
+	}
+
+	if(cfg->sub_slots != NULL)
+		mem_free(&cfg->alloc, cfg->sub_slots, ((cfg->sub_mask + 1) * sizeof(struct config_sub *)));
+
+	cfg->sub_slots = NULL;
+	cfg->sub_mask = 0;
+}
+
+/*
+ * Here we start our static functions for the cache used by
+ * config_open_cached().
+ *
+ * Each version of a file that's been opened this way is parsed
+ * once, into a snapshot that's shared by every handle opened
+ * on it. Handles are ordinary CONFIGs with their own keylist
+ * position, index, and overrides, whose keylist belongs to the
+ * snapshot.
+ *
+ * A file is known by its device, inode, modification time, and
+ * size, so a file that's been changed or replaced gets a new
+ * snapshot. The old one is marked stale, and dropped once the
+ * last handle on it is closed.
+ */
+
+struct config_snapshot
+{
+	struct config_snapshot *next;
+	CONFIG         *cfg;
+	dev_t           dev;
+	ino_t           ino;
+	struct timespec mtime;
+	off_t           size;
+	int             flags;
+	size_t          users;
+	int             stale;
+	struct config_allocator alloc;
+	size_t          path_len;
+	char            path[];
+};
+
+static struct config_snapshot *snapshot_list = NULL;
+#ifndef NO_PTHREAD
+static pthread_mutex_t snapshot_lock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static void snapshot_enter(void)
+{
+	#ifndef NO_PTHREAD
+	pthread_mutex_lock(&snapshot_lock);
+	#endif
+}
+
+static void snapshot_leave(void)
+{
+	#ifndef NO_PTHREAD
+	pthread_mutex_unlock(&snapshot_lock);
+	#endif
+}
+
+static int snapshot_same(const struct config_snapshot *restrict snap, const struct stat *restrict info, int flags)
+{
+	return snap->dev == info->st_dev && snap->ino == info->st_ino &&
+	       snap->mtime.tv_sec == info->st_mtim.tv_sec && snap->mtime.tv_nsec == info->st_mtim.tv_nsec &&
+	       snap->size == info->st_size && snap->flags == flags;
+}
+
+// Returns the current snapshot of a file, if there is one.
+// The cache must be locked.
+static struct config_snapshot *snapshot_find(const struct stat *restrict info, int flags)
+{
+	for(struct config_snapshot *snap = snapshot_list; snap != NULL; snap = snap->next)
+	{
+		if(!snap->stale && snapshot_same(snap, info, flags))
+			return snap;
+	}
+
+	return NULL;
+}
+
+static void snapshot_free(struct config_snapshot *restrict snap)
+{
+	struct config_allocator alloc = snap->alloc;
+
+	config_free(snap->cfg);
+	mem_free(&alloc, snap, (sizeof(struct config_snapshot) + snap->path_len + 1));
+}
+
+// Marks the older snapshots of the same file stale, now that
+// 'fresh' has replaced them, and takes the ones nobody is using
+// out of the cache.
+// They're handed back on 'dead', to be freed once the cache is
+// unlocked.
+static void snapshot_expire(const struct config_snapshot *restrict fresh, struct config_snapshot **restrict dead)
+{
+	struct config_snapshot **link = &snapshot_list;
+
+	while(*link != NULL)
+	{
+		struct config_snapshot *snap = *link;
+
+		if(snap != fresh && snap->flags == fresh->flags &&
+		   ((snap->dev == fresh->dev && snap->ino == fresh->ino) ||
+		    (snap->path_len == fresh->path_len && memcmp(snap->path, fresh->path, snap->path_len) == 0)))
+			snap->stale = 1;
+
+		if(snap->stale && snap->users == 0)
+		{
+			*link = snap->next;
+			snap->next = *dead;
+			*dead = snap;
+		}
+		else
+			link = &snap->next;
+	}
+}
+
+// Gives up one use of a snapshot.
+static void snapshot_put(struct config_snapshot *restrict snap)
+{
+	struct config_snapshot *dead = NULL;
+
+	snapshot_enter();
+
+	if(--snap->users == 0 && snap->stale)
+	{
+		struct config_snapshot **link = &snapshot_list;
+
+		for(; *link != snap; link = &(*link)->next);
+		*link = snap->next;
+		dead = snap;
+	}
+
+	snapshot_leave();
+
+	if(dead != NULL)
+		snapshot_free(dead);
+}
+
+// Lets go of the snapshot a handle was opened on.
+// The keylist goes with it, so the handle is left empty.
+static void snapshot_release(CONFIG *restrict cfg)
+{
+	if(cfg->snapshot != NULL)
+		snapshot_put(cfg->snapshot);
+
+	cfg->snapshot = NULL;
+}
+
+/*
+ * Here we start our static functions for packing a keylist.
+ *
+ * A packed keylist is a single block, holding an array of keys
+ * followed by all of their names and values, with nothing to
+ * spare.
+ * It's used by config_finish(), and for shared images.
+ */
+
+// Returns the room needed for the names and values in the
+// keylist of 'cfg', and stores the number of keys in 'count'.
+// Tags don't need room for their values, as they share one.
+static size_t pack_size(CONFIG *restrict cfg, size_t *restrict count)
+{
+	size_t size = 0;
+
+	*count = 0;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next)
+	{
+		key_load(current);
+
+		(*count)++;
+		size += current->name_len + 1;
+		if(!(current->value_len == 1 && current->value[0] == '\n'))
+			size += current->value_len + 1;
+	}
+
+	return size;
+}
+
+// Copies the keylist of 'cfg' to 'nodes', and its strings to
+// 'strings', pointing every tag at 'tag_value'.
+static void pack_write(CONFIG *restrict cfg, k_list *restrict nodes, char *restrict strings, size_t count, char *tag_value)
+{
+	size_t i = 0;
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next, i++)
+	{
+		k_list *key = &nodes[i];
+
+		key_load(current);
+
+		key->name = strings;
+		key->name_len = current->name_len;
+		memcpy(strings, current->name, (current->name_len + 1));
+		strings += current->name_len + 1;
+
+		if(current->value_len == 1 && current->value[0] == '\n')
+			key->value = tag_value;
+		else
+		{
+			key->value = strings;
+			memcpy(strings, current->value, (current->value_len + 1));
+			strings += current->value_len + 1;
+		}
+
+		key->value_len = current->value_len;
+		key->name_size = 0;
+		key->name_hash = current->name_hash;
+		key->loaded = 1;
+		key->pooled = 0;
+		key->key_next = (i + 1 < count) ? &nodes[i + 1] : NULL;
+	}
+}
+
+// The header of a shared image, as made by
+// config_share_publish().
+//
+// It's followed by the keys, then their names and values.
+// Nothing in the image is a pointer. Keys hold the offsets of
+// their names and values from the start of the image, so it can
+// be mapped anywhere without being changed.
+//
+// A CONFIG attached to an image doesn't keep a keylist of its
+// own, as that would take memory in every process for every
+// key. The search, next, and index functions read the keys
+// straight from the image instead, by position.
+struct share_image
+{
+	uint32_t        magic;
+	int             flags;
+	unsigned long   generation;
+	size_t          size;
+	size_t          count;
+	char            tag_value[2];
+};
+
+// A key, as it's kept in a shared image.
+struct share_key
+{
+	size_t          name;
+	size_t          value;
+	size_t          name_len;
+	size_t          value_len;
+	uint32_t        name_hash;
+};
+
+static void image_free(CONFIG *restrict cfg)
+{
+	#ifndef NO_SHM
+	if(cfg->image != NULL)
+		munmap(cfg->image, cfg->image->size);
+	#endif
+	cfg->image = NULL;
+}
+
+// Rounds 'len' up so the next thing in the image is aligned
+// for any of the types we keep there.
+static size_t image_align(size_t len)
+{
+	size_t align = _Alignof(max_align_t);
+
+	return (len + align - 1) & ~(align - 1);
+}
+
+// Fills 'view' with the key at 'index' in the image at 'head',
+// or returns NULL past the last key.
+// The name and value are left where they are in the image.
+static k_list *image_key(const struct share_image *restrict head, size_t index, k_list *restrict view)
+{
+	if(index >= head->count)
+		return NULL;
+
+	const struct share_key *key = (const struct share_key *)((const char *)head + image_align(sizeof(struct share_image))) + index;
+
+	view->name = (char *)head + key->name;
+	view->value = (char *)head + key->value;
+	view->name_len = key->name_len;
+	view->value_len = key->value_len;
+	view->name_size = 0;
+	view->name_hash = key->name_hash;
+	view->loaded = 1;
+	view->pooled = 0;
+	view->key_next = NULL;
+
+	return view;
+}
+
+// Gives an attached CONFIG a keylist after all, for the few
+// functions that keep pointers to keys, such as the sorted
+// index and stacks.
+// It's only made once they're used, and only the list itself
+// is private; the names and values stay in the image.
+static int image_nodes(CONFIG *restrict cfg)
+{
+	const struct share_image *head = cfg->image;
+
+	if(head == NULL || head->count == 0 || cfg->key_list != NULL)
+		return 0;
+
+	size_t size = head->count * sizeof(k_list);
+
+	k_list *nodes = mem_alloc(&cfg->alloc, size);
+	if(nodes == NULL)
+		return -1;
+
+	for(size_t i = 0; i < head->count; i++)
+	{
+		image_key(head, i, &nodes[i]);
+		nodes[i].key_next = (i + 1 < head->count) ? &nodes[i + 1] : NULL;
+	}
+
+	cfg->key_list = nodes;
+	cfg->packed = nodes;
+	cfg->packed_size = size;
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for getting at the keys
+ * of either kind of CONFIG.
+ *
+ * Those that take a 'view' fill it in with the key when it's
+ * in an image, so it only lasts as long as the view does. The
+ * names and values they point at last as long as the image.
+ */
+
+// Returns 1 if 'cfg' has no keys at all.
+static int key_none(const CONFIG *restrict cfg)
+{
+	if(cfg->image != NULL)
+		return cfg->image->count == 0;
+
+	return cfg->key_list == NULL;
+}
+
+// Gives the key at the keylist position of 'cfg', or NULL at
+// the end of the list.
+// Lazily read values are left as they are.
+static k_list *key_here(CONFIG *restrict cfg, k_list *restrict view)
+{
+	if(cfg->image != NULL)
+		return image_key(cfg->image, cfg->image_pos, view);
+
+	return *cfg->key_current;
+}
+
+// Returns 1 if the keylist position of 'cfg' is at the end of
+// the list.
+static int key_end(const CONFIG *restrict cfg)
+{
+	if(cfg->image != NULL)
+		return cfg->image_pos >= cfg->image->count;
+
+	return *cfg->key_current == NULL;
+}
+
+// Moves the keylist position past the key it's at.
+static void key_step(CONFIG *restrict cfg)
+{
+	if(cfg->image != NULL)
+		cfg->image_pos++;
+	else
+		cfg->key_current = &(*cfg->key_current)->key_next;
+}
+
+// Moves the keylist position back to the start.
+static void key_rewind(CONFIG *restrict cfg)
+{
+	cfg->key_current = &cfg->key_list;
+	cfg->image_pos = 0;
+}
+
+// Gives the key at 'index', without using the keylist position.
+static k_list *key_index(CONFIG *restrict cfg, unsigned int index, k_list *restrict view)
+{
+	if(cfg->image != NULL)
+	{
+		k_list *key = image_key(cfg->image, index, view);
+		if(key == NULL)
+			errno = 0;
+		return key;
+	}
+
+	return key_load(list_get(index, cfg->key_list));
+}
+
+// Walks every key of 'cfg' in order, without using the keylist
+// position. 'key' is NULL to start with, and '*pos' counts the
+// keys of an image.
+static k_list *key_walk(CONFIG *restrict cfg, k_list *restrict key, size_t *restrict pos, k_list *restrict view)
+{
+	if(cfg->image != NULL)
+	{
+		*pos = (key == NULL) ? 0 : (*pos + 1);
+		return image_key(cfg->image, *pos, view);
+	}
+
+	return (key == NULL) ? cfg->key_list : key->key_next;
+}
+
+/*
+ * Here we start our static functions for driving a read.
+ * These are shared by config_read() and the feed functions.
+ */
+
+// Throws away the keylist, and anything left from a read
+// that didn't finish.
+//
+// The keys are kept as spares for the next read.
+static void read_reset(CONFIG *restrict cfg)
+{
+	// The keys of an attached image, a cached snapshot, or a
+	// packed keylist can't be reused one at a time, so we let
+	// go of them all.
+	if(cfg->image == NULL && cfg->snapshot == NULL && cfg->packed == NULL && cfg->key_list != NULL)
+	{
+		*cfg->key_tail = cfg->key_spare;
+		cfg->key_spare = cfg->key_list;
+	}
+
+	cfg->key_list = NULL;
+	snapshot_release(cfg);
+	image_free(cfg);
+
+	if(cfg->packed != NULL)
+		mem_free(&cfg->alloc, cfg->packed, cfg->packed_size);
+
+	cfg->packed = NULL;
+	cfg->packed_size = 0;
+
+	index_free(cfg);
+
+	if(cfg->key_build != NULL)
+	{
+		cfg->key_build->key_next = cfg->key_spare;
+		cfg->key_spare = cfg->key_build;
+	}
+
+	cfg->key_current = NULL;
+	cfg->key_tail = &cfg->key_list;
+	cfg->key_build = NULL;
+	cfg->tok_state = TOK_START;
+	cfg->buff_pos = 0;
+	cfg->read_bytes = 0;
+	cfg->read_entries = 0;
+	cfg->read_line = 0;
+	cfg->append_state = APPEND_OFF;
+	cfg->reading = 0;
+	cfg->generation++;
+}
+
+// Gets a CONFIG ready to start a new read.
+static void read_begin(CONFIG *restrict cfg)
+{
+	read_reset(cfg);
+	cfg->reading = 1;
+}
+
+// Takes the next chunk of input.
+// In lazy mode we only collect it, as we can't split the
+// buffer up until we've seen all of it.
+static int read_chunk(CONFIG *restrict cfg, const char *restrict data, size_t len)
+{
+	if(limit_input(cfg, data, len) == -1)
+		return -1;
+
+	if(cfg->append_state == APPEND_TRACK)
+		return append_feed(cfg, data, len);
+
+	if(!(cfg->flags & CONFIG_LAZY))
+		return tok_feed(cfg, data, len);
+
+	if(buff_reserve(cfg, len) == -1)
+		return -1;
+
+	memcpy((cfg->buff + cfg->buff_pos), data, len);
+	cfg->buff_pos += len;
+
+	return 0;
+}
+
+// Finishes a read once there's no more input.
+// A last line without a newline is still a line.
+static int read_end(CONFIG *restrict cfg)
+{
+	if(cfg->flags & CONFIG_LAZY)
+	{
+		if(buff_reserve(cfg, 0) == -1 || lazy_scan(cfg) == -1)
+			return -1;
+	}
+	else if(cfg->tok_state != TOK_START && cfg->tok_state != TOK_COMMENT)
+	{
+		if(key_finish(cfg) == -1)
+			return -1;
+	}
+
+	cfg->tok_state = TOK_START;
+	cfg->key_current = &cfg->key_list;
+	cfg->reading = 0;
+	cfg->generation++;
+
+	if(cfg->append_state == APPEND_TRACK)
+		cfg->append_state = APPEND_READY;
+
+	// Subscribers are only told once the keylist is whole.
+	sub_notify(cfg);
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for append-only files.
+ *
+ * When a CONFIG is opened with CONFIG_APPEND, config_read()
+ * keeps a print of everything it has read, up to the end of
+ * the last whole line, and where in the keylist that line
+ * ended.
+ * If the next read finds that part of the file unchanged, it
+ * keeps the keys it already has, and only parses what follows.
+ */
+
+// Adds 'len' bytes to a running print.
+// Whole words are put together a byte at a time, so the print
+// is the same on any byte order, but compilers turn that into
+// a single load.
+static void append_mix(struct append_print *restrict run, const char *restrict data, size_t len)
+{
+	const unsigned char *pos = (const unsigned char *)data;
+	const unsigned char *end = pos + len;
+	uint64_t print = run->print;
+	uint64_t word = run->word;
+	unsigned int fill = run->fill;
+
+	while(pos < end)
+	{
+		if(fill == 0 && (end - pos) >= 8)
+		{
+			word = (uint64_t)pos[0] | ((uint64_t)pos[1] << 8) | ((uint64_t)pos[2] << 16) | ((uint64_t)pos[3] << 24) |
+			       ((uint64_t)pos[4] << 32) | ((uint64_t)pos[5] << 40) | ((uint64_t)pos[6] << 48) | ((uint64_t)pos[7] << 56);
+			pos += 8;
+		}
+		else
+		{
+			word |= (uint64_t)*pos++ << (fill * 8);
+			if(++fill < 8)
+				continue;
+		}
+
+		// The shift folds the high bits back down, as the
+		// multiply alone only carries changes upward.
+		print ^= word;
+		print *= PRINT_PRIME;
+		print ^= print >> 32;
+		word = 0;
+		fill = 0;
+	}
+
+	run->print = print;
+	run->word = word;
+	run->fill = fill;
+}
+
+// Takes the next chunk of a file we're keeping track of.
+// The chunk is parsed in two parts, split after its last
+// newline, so we can mark where the last whole line ended.
+static int append_feed(CONFIG *restrict cfg, const char *restrict data, size_t len)
+{
+	size_t head = len;
+
+	for(; head > 0 && data[head - 1] != '\n'; head--);
+
+	if(head > 0)
+	{
+		if(tok_feed(cfg, data, head) == -1)
+			return -1;
+
+		append_mix(&cfg->append_run, data, head);
+		cfg->append_read += head;
+
+		// Every line is finished after a newline, so the
+		// keylist ends exactly here.
+		cfg->append_offset = cfg->append_read;
+		cfg->append_mark = cfg->append_run;
+		cfg->append_tail = cfg->key_tail;
+		cfg->append_entries = cfg->read_entries;
+	}
+
+	if(tok_feed(cfg, (data + head), (len - head)) == -1)
+		return -1;
+
+	append_mix(&cfg->append_run, (data + head), (len - head));
+	cfg->append_read += len - head;
+
+	return 0;
+}
+
+// Checks whether the part of the file we read last time is
+// still there, as it was.
+// Returns 1 if it is, and 0 if it isn't.
+static int append_check(CONFIG *restrict cfg)
+{
+	struct stat info;
+
+	if(fstat(cfg->fd, &info) == -1)
+		return -1;
+
+	if(!S_ISREG(info.st_mode) || info.st_size < cfg->append_offset)
+		return 0;
+
+	struct append_print print = {PRINT_BASIS, 0, 0};
+	off_t position = 0;
+
+	while(position < cfg->append_offset)
+	{
+		size_t want = cfg->buff_size;
+
+		if((off_t)want > cfg->append_offset - position)
+			want = cfg->append_offset - position;
+
+		ssize_t state = pread(cfg->fd, cfg->buff, want, position);
+		if(state == -1 && errno == EINTR)
+			continue;
+		else if(state == -1)
+			return -1;
+		else if(state == 0)
+			return 0;
+
+		append_mix(&print, cfg->buff, state);
+		position += state;
+	}
+
+	return (print.print == cfg->append_mark.print && print.word == cfg->append_mark.word && print.fill == cfg->append_mark.fill);
+}
+
+// Starts a read of a CONFIG opened with CONFIG_APPEND.
+//
+// If what we read last time hasn't changed, we keep its keys
+// and carry on from the end of its last whole line. Keys from
+// a last line without a newline are read again, along with
+// whatever has been added to it.
+// Otherwise, we read the whole file again, from the start.
+//
+// Lazy keys all point into the one buffer, so those files are
+// always read in full.
+static int append_begin(CONFIG *restrict cfg)
+{
+	if(cfg->append_state == APPEND_READY && cfg->image == NULL && cfg->snapshot == NULL && cfg->packed == NULL)
+	{
+		int state = append_check(cfg);
+		if(state == -1)
+			return -1;
+
+		if(state == 1 && lseek(cfg->fd, cfg->append_offset, SEEK_SET) != -1)
+		{
+			if(cfg->max_bytes > 0 && (uintmax_t)cfg->append_offset > cfg->max_bytes)
+			{
+				errno = EFBIG;
+				return -1;
+			}
+
+			if(cfg->max_entries > 0 && cfg->append_entries > cfg->max_entries)
+			{
+				errno = EFBIG;
+				return -1;
+			}
+
+			k_list *rest = *cfg->append_tail;
+			if(rest != NULL)
+			{
+				*cfg->key_tail = cfg->key_spare;
+				cfg->key_spare = rest;
+				*cfg->append_tail = NULL;
+			}
+
+			index_free(cfg);
+
+			cfg->key_current = NULL;
+			cfg->key_tail = cfg->append_tail;
+			cfg->tok_state = TOK_START;
+			cfg->read_bytes = (cfg->max_bytes > 0) ? (size_t)cfg->append_offset : 0;
+			cfg->read_entries = cfg->append_entries;
+			cfg->read_line = 0;
+			cfg->append_read = cfg->append_offset;
+			cfg->append_run = cfg->append_mark;
+			cfg->append_state = APPEND_TRACK;
+			cfg->reading = 1;
+			cfg->generation++;
+
+			return 0;
+		}
+	}
+
+	read_begin(cfg);
+
+	// Pipes and the like can't be read again, so there's no
+	// point keeping track of them.
+	if(lseek(cfg->fd, 0, SEEK_SET) == -1)
+		return (errno == ESPIPE) ? 0 : -1;
+
+	if(cfg->flags & CONFIG_LAZY)
+		return 0;
+
+	cfg->append_read = 0;
+	cfg->append_offset = 0;
+	cfg->append_run = (struct append_print){PRINT_BASIS, 0, 0};
+	cfg->append_mark = cfg->append_run;
+	cfg->append_tail = &cfg->key_list;
+	cfg->append_entries = 0;
+	cfg->append_state = APPEND_TRACK;
+
+	return 0;
+}
+
+/*
+ * Here we start our static functions for runtime overrides.
+ *
+ * Overrides are kept in a small hash table that's never changed
+ * once it's been published. Writers build a new table, under a
+ * mutex, and swap it in with a single atomic store, so readers
+ * never wait on a lock.
+ *
+ * Readers announce themselves on one of two counters, picked by
+ * the parity of an epoch, while they use the table. A writer
+ * that swaps a table in moves the epoch on, and waits for the
+ * counter of the old one to drain, which only takes as long as
+ * a single lookup. After that nobody can be using the old table,
+ * so it's freed right away, with the override it replaced.
+ */
+
+struct override
+{
+	k_list           key;
+};
+
+struct override_map
+{
+	size_t               count;
+	size_t               mask;
+	struct override     *slots[];
+};
+
+static uint32_t override_hash(const CONFIG *restrict cfg, const char *restrict name, size_t len)
+{
+	if(cfg->flags & CONFIG_ICASE)
+		return fold_hash(name, len);
+	else
+		return str_hash(name, len);
+}
+
+// Returns the position in 'map' of 'name', or of the empty
+// slot where it belongs.
+static size_t override_slot(const CONFIG *restrict cfg, const struct override_map *restrict map, const char *restrict name, size_t len, uint32_t hash)
+{
+	size_t i = hash & map->mask;
+
+	while(map->slots[i] != NULL)
+	{
+		const k_list *key = &map->slots[i]->key;
+
+		// key_match() only checks the hash in case-folding
+		// mode, so we check it first here.
+		if(key->name_hash == hash && key_match(cfg, key, name, len, hash))
+			break;
+
+		i = (i + 1) & map->mask;
+	}
+
+	return i;
+}
+
+static struct override *override_new(CONFIG *restrict cfg, const char *restrict name, size_t name_len, const char *restrict value, size_t value_len)
+{
+	struct override *over = mem_alloc(&cfg->alloc, (sizeof(struct override) + name_len + value_len + 2));
+	if(over == NULL)
+		return NULL;
+
+	char *strings = (char *)(over + 1);
+
+	memcpy(strings, name, name_len);
+	strings[name_len] = '\0';
+	memcpy((strings + name_len + 1), value, value_len);
+	strings[name_len + value_len + 1] = '\0';
+
+	over->key.name = strings;
+	over->key.value = strings + name_len + 1;
+	over->key.name_len = name_len;
+	over->key.value_len = value_len;
+	over->key.name_size = 0;
+	over->key.name_hash = override_hash(cfg, name, name_len);
+	over->key.loaded = 1;
+	over->key.pooled = 0;
+	over->key.key_next = NULL;
+
+	return over;
+}
+
+static void override_release(CONFIG *restrict cfg, struct override *restrict over)
+{
+	mem_free(&cfg->alloc, over, (sizeof(struct override) + over->key.name_len + over->key.value_len + 2));
+}
+
+static void override_map_release(CONFIG *restrict cfg, struct override_map *restrict map)
+{
+	mem_free(&cfg->alloc, map, (sizeof(struct override_map) + (map->mask + 1) * sizeof(struct override *)));
+}
+
+// Makes a copy of 'old' with room for at least 'count' over-
+// rides, leaving out 'skip'.
+static struct override_map *override_copy(CONFIG *restrict cfg, const struct override_map *restrict old, size_t count, const struct override *restrict skip)
+{
+	size_t size = 8;
+	while(size < count * 2)
+		size *= 2;
+
+	struct override_map *map = mem_zalloc(&cfg->alloc, (sizeof(struct override_map) + size * sizeof(struct override *)));
+	if(map == NULL)
+		return NULL;
+
+	map->mask = size - 1;
+
+	for(size_t i = 0; old != NULL && i <= old->mask; i++)
+	{
+		struct override *over = old->slots[i];
+
+		if(over == NULL || over == skip)
+			continue;
+
+		map->slots[override_slot(cfg, map, over->key.name, over->key.name_len, over->key.name_hash)] = over;
+		map->count++;
+	}
+
+	return map;
+}
+
+// Waits until nobody can still be using a table that was
+// swapped out before the call.
+//
+// Readers that came in before the epoch moved on are counted
+// on the old counter, and we wait for them to leave. Readers
+// counted on the other one checked the epoch again after
+// counting themselves, and saw it after the swap, so they
+// can only have the new table.
+static void override_sync(CONFIG *restrict cfg)
+{
+	unsigned int epoch = atomic_fetch_add(&cfg->override_epoch, 1);
+
+	while(atomic_load(&cfg->override_readers[epoch & 1]) != 0)
+	{
+		#ifndef NO_PTHREAD
+		sched_yield();
+		#endif
+	}
+}
+
+// Swaps in a new table, and frees the old one, along with
+// 'dead', the override it no longer has.
+static void override_publish(CONFIG *restrict cfg, struct override_map *restrict map, struct override *restrict dead)
+{
+	struct override_map *old = atomic_exchange(&cfg->overrides, map);
+
+	override_sync(cfg);
+
+	if(old != NULL)
+		override_map_release(cfg, old);
+
+	if(dead != NULL)
+		override_release(cfg, dead);
+}
+
+// Starts using the current table, if there is one.
+// Every call that returns a table must be matched by a call to
+// override_leave(), with the same 'epoch'.
+static struct override_map *override_enter(CONFIG *restrict cfg, unsigned int *restrict epoch)
+{
+	if(atomic_load_explicit(&cfg->overrides, memory_order_relaxed) == NULL)
+		return NULL;
+
+	for(;;)
+	{
+		*epoch = atomic_load(&cfg->override_epoch);
+		atomic_fetch_add(&cfg->override_readers[*epoch & 1], 1);
+
+		if(atomic_load(&cfg->override_epoch) == *epoch)
+			break;
+
+		// A writer moved the epoch on while we were counting
+		// ourselves, and may not be waiting for us.
+		atomic_fetch_sub(&cfg->override_readers[*epoch & 1], 1);
+	}
+
+	struct override_map *map = atomic_load(&cfg->overrides);
+	if(map == NULL)
+		atomic_fetch_sub(&cfg->override_readers[*epoch & 1], 1);
+
+	return map;
+}
+
+static void override_leave(CONFIG *restrict cfg, struct override_map *restrict map, unsigned int epoch)
+{
+	if(map != NULL)
+		atomic_fetch_sub_explicit(&cfg->override_readers[epoch & 1], 1, memory_order_release);
+}
+
+static int override_init(CONFIG *restrict cfg)
+{
+	atomic_init(&cfg->overrides, NULL);
+	atomic_init(&cfg->override_epoch, 0);
+	atomic_init(&cfg->override_readers[0], 0);
+	atomic_init(&cfg->override_readers[1], 0);
+
+	#ifndef NO_PTHREAD
+	if(pthread_mutex_init(&cfg->override_lock, NULL) != 0)
+		return -1;
+	#endif
+
+	return 0;
+}
+
+// Drops every override.
+static void override_clear(CONFIG *restrict cfg)
+{
+	struct override_map *map = atomic_load(&cfg->overrides);
+
+	for(size_t i = 0; map != NULL && i <= map->mask; i++)
+	{
+		if(map->slots[i] != NULL)
+			override_release(cfg, map->slots[i]);
+	}
+	if(map != NULL)
+		override_map_release(cfg, map);
+	atomic_store(&cfg->overrides, NULL);
+}
+
+static void override_free(CONFIG *restrict cfg)
+{
+	override_clear(cfg);
+
+	#ifndef NO_PTHREAD
+	pthread_mutex_destroy(&cfg->override_lock);
+	#endif
+}
+
+// Moves the keylist position of 'cfg' forward to the next key
+// named 'name', or to the end of the list, and returns that
+// key.
+static k_list *key_seek(CONFIG *restrict cfg, const char *restrict name, size_t len, k_list *restrict view)
+{
+	uint32_t hash = 0;
+	k_list *key;
+
+	if(cfg->flags & CONFIG_ICASE)
+		hash = fold_hash(name, len);
+
+	while((key = key_here(cfg, view)) != NULL && !key_match(cfg, key, name, len, hash))
+		key_step(cfg);
+
+	return key_load(key);
+}
+
+// Does the work of the search functions.
+// This moves the keylist position past the next key named
+// 'name', and returns the key to hand out, which may be an
+// override.
+//
+// An override replaces the value of every key of its name.
+// If there's no such key, it's still found by a search that
+// starts from the beginning of the keylist.
+//
+// '*map' and '*epoch' are set to the table in use, which must
+// be given to override_leave() once the key has been used.
+// 'view' is as for key_here().
+static const k_list *key_search(CONFIG *restrict cfg, const char *restrict name, size_t len, struct override_map **restrict map, unsigned int *restrict epoch, k_list *restrict view)
+{
+	int from_start = (cfg->image != NULL) ? (cfg->image_pos == 0) : (cfg->key_current == &cfg->key_list);
+
+	k_list *found = key_seek(cfg, name, len, view);
+	if(found != NULL)
+		key_step(cfg);
+
+	*map = override_enter(cfg, epoch);
+	if(*map == NULL)
+		return found;
+
+	uint32_t hash = override_hash(cfg, name, len);
+	struct override *over = (*map)->slots[override_slot(cfg, *map, name, len, hash)];
+
+	if(over != NULL && (found != NULL || from_start))
+		return &over->key;
+
+	return found;
+}
+
+// Does the work of the lookup functions.
+// This is the same as a search from the beginning of the
+// keylist, but doesn't move the keylist position, so any number
+// of threads may do it at once.
+//
+// '*map', '*epoch', and 'view' are as for key_search(). The key
+// that's returned still needs key_load_shared() before it's
+// used.
+static k_list *key_lookup(CONFIG *restrict cfg, const char *restrict name, size_t len, struct override_map **restrict map, unsigned int *restrict epoch, k_list *restrict view)
+{
+	uint32_t hash = 0;
+	size_t pos = 0;
+
+	*map = override_enter(cfg, epoch);
+	if(*map != NULL)
+	{
+		uint32_t over_hash = override_hash(cfg, name, len);
+		struct override *over = (*map)->slots[override_slot(cfg, *map, name, len, over_hash)];
+
+		if(over != NULL)
+			return &over->key;
+	}
+
+	if(cfg->flags & CONFIG_ICASE)
+		hash = fold_hash(name, len);
+
+	for(k_list *key = key_walk(cfg, NULL, &pos, view); key != NULL; key = key_walk(cfg, key, &pos, view))
+	{
+		if(key_match(cfg, key, name, len, hash))
+			return key;
+	}
+
+	return NULL;
+}
+
+// Sets up a newly allocated CONFIG around an open descriptor.
+// This is shared by all of the open functions.
+// 'fd' may be -1 for a CONFIG that isn't attached to a file.
+static int config_init(CONFIG *restrict cfg, int fd, int flags)
+{
+	ssize_t block_size = 0;
+
+	if(fd >= 0)
+	{
+		block_size = get_block_size(fd);
+		if(block_size < 0)
+			return -1;
+	}
+
+	cfg->fd = fd;
+	cfg->flags = flags;
+	cfg->block_size = block_size;
+	cfg->buff = NULL;
+	cfg->buff_size = 0;
+	cfg->buff_pos = 0;
+	cfg->key_list = NULL;
+	cfg->key_current = NULL;
+	cfg->key_sorted = NULL;
+	cfg->key_count = 0;
+	cfg->key_sorted_size = 0;
+	cfg->key_indexed = 0;
+	cfg->value_slots = NULL;
+	cfg->value_mask = 0;
+	cfg->values = NULL;
+	cfg->values_size = 0;
+	cfg->values_built = 0;
+	cfg->view.count = 0;
+	cfg->view.entries = NULL;
+	cfg->entries = NULL;
+	cfg->entries_size = 0;
+	cfg->view_built = 0;
+	cfg->subs = NULL;
+	cfg->sub_slots = NULL;
+	cfg->sub_mask = 0;
+	cfg->sub_firing = 0;
+	cfg->snapshot = NULL;
+	cfg->packed = NULL;
+	cfg->packed_size = 0;
+	cfg->key_spare = NULL;
+	cfg->max_bytes = 0;
+	cfg->max_entries = 0;
+	cfg->max_line = 0;
+	cfg->max_value = 0;
+	cfg->read_bytes = 0;
+	cfg->read_entries = 0;
+	cfg->read_line = 0;
+	cfg->append_state = APPEND_OFF;
+	cfg->append_read = 0;
+	cfg->append_offset = 0;
+	cfg->append_run = (struct append_print){0};
+	cfg->append_mark = (struct append_print){0};
+	cfg->append_tail = NULL;
+	cfg->append_entries = 0;
+	cfg->alloc = default_allocator;
+	cfg->alloc_self = default_allocator;
+	cfg->pool = NULL;
+	cfg->reading = 0;
+	cfg->tok_state = TOK_START;
+	cfg->key_build = NULL;
+	cfg->key_tail = &cfg->key_list;
+	cfg->generation = 0;
+	cfg->image = NULL;
+	cfg->image_pos = 0;
+
+	return override_init(cfg);
+}
+
+// Frees a CONFIG and everything it holds.
+// The descriptor must already be closed.
+static void config_free(CONFIG *restrict cfg)
+{
+	read_reset(cfg);
+	list_free(cfg, &cfg->key_spare);
+	pool_detach(cfg);
+	image_free(cfg);
+	override_free(cfg);
+	sub_free(cfg);
+	mem_free(&cfg->alloc, cfg->key_sorted, (cfg->key_sorted_size * 2 * sizeof(k_list *)));
+	mem_free(&cfg->alloc, cfg->values, (cfg->values_size * sizeof(char *)));
+	mem_free(&cfg->alloc, cfg->entries, (cfg->entries_size * sizeof(struct config_entry)));
+	if(cfg->value_slots != NULL)
+		mem_free(&cfg->alloc, cfg->value_slots, ((cfg->value_mask + 1) * sizeof(struct value_slot)));
+	mem_free(&cfg->alloc, cfg->buff, (cfg->buff_size + 1));
+
+	struct config_allocator self = cfg->alloc_self;
+	mem_free(&self, cfg, sizeof(CONFIG));
+}
+
+/*
+ * Here we get into the public functions of the library.
+ * This should be the only part most people interact with.
+ *
+ * If you want descriptions of them, check the manpages.
+ */
+ 
+CONFIG *config_open(const char *restrict path)
+{
+	return config_open_flags(path, 0);
+}
+
+CONFIG *config_open_flags(const char *restrict path, int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	CONFIG *init = mem_alloc(&default_allocator, sizeof(CONFIG));
+	if(init == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		goto fail;
+	// I'm using goto for error handling.
+	// Eat me.
+	// 			-Luna
+	
+	if(config_init(init, fd, flags) == -1)
+	{
+		close(fd);
+		goto fail;
+	}
+	
+	set_sigmask(SIGMASK_RST);
+	return init;
+
+	fail:
+		set_sigmask(SIGMASK_RST);
+		mem_free(&default_allocator, init, sizeof(CONFIG));
+		return NULL;
+}
+
+CONFIG *config_fdopen(int fd)
+{
+	return config_fdopen_flags(fd, 0);
+}
+
+// This one's not quite done, but it's here.
+// We're missing some checking to ensure the we can actually
+// use the descriptor we were passed.
+CONFIG *config_fdopen_flags(int fd, int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	int fd_flags = fcntl(fd, F_GETFL);
+	if(fd_flags == -1)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+	else if((fd_flags & O_WRONLY))
+	{
+		errno = EBADF;
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+
+	CONFIG *init = mem_alloc(&default_allocator, sizeof(CONFIG));
+	if(init == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	if(config_init(init, fd, flags) == -1)
+		goto fail;
+
+	set_sigmask(SIGMASK_RST);
+	return init;
+
+	fail:
+		set_sigmask(SIGMASK_RST);
+		mem_free(&default_allocator, init, sizeof(CONFIG));
+		return NULL;
+}
+
+// A reopened CONFIG keeps the flags it was originally
+// opened with.
+// The CONFIG is kept, along with its buffers and keys, so a
+// service that reloads often doesn't have to keep allocating
+// them again.
+CONFIG *config_reopen(const char *restrict path, CONFIG *cfg)
+{
+	if(cfg == NULL)
+		return config_open(path);
+
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	if(cfg->fd >= 0 && close(cfg->fd) != 0)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	cfg->fd = -1;
+	read_reset(cfg);
+	image_free(cfg);
+	override_clear(cfg);
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		goto fail;
+
+	ssize_t block_size = get_block_size(fd);
+	if(block_size < 0)
+	{
+		close(fd);
+		goto fail;
+	}
+
+	cfg->fd = fd;
+	cfg->block_size = block_size;
+
+	set_sigmask(SIGMASK_RST);
+	return cfg;
+
+	// Like freopen(), we don't give back the old CONFIG if we
+	// can't open the new file.
+	fail:
+		{
+			int err = errno;
+			config_free(cfg);
+			errno = err;
+		}
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+}
+
+// Creates a CONFIG that isn't attached to any file.
+// It can only be filled using config_feed().
+CONFIG *config_create(int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	CONFIG *init = mem_alloc(&default_allocator, sizeof(CONFIG));
+	if(init == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	if(config_init(init, -1, flags) == -1)
+	{
+		mem_free(&default_allocator, init, sizeof(CONFIG));
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return init;
+}
+
+CONFIG *config_open_cached(const char *restrict path)
+{
+	return config_open_cached_flags(path, 0);
+}
+
+// Opens a handle on the parsed contents of 'path', shared with
+// every other handle opened on the same version of the file.
+// The handle is already read, and can't be read again.
+CONFIG *config_open_cached_flags(const char *restrict path, int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	if(path == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	struct config_snapshot *snap = NULL;
+	struct config_snapshot *dead = NULL;
+	CONFIG *init = NULL;
+	struct stat info;
+
+	int fd = open(path, O_RDONLY);
+	if(fd < 0)
+		goto fail;
+
+	if(fstat(fd, &info) != 0)
+	{
+		int err = errno;
+		close(fd);
+		errno = err;
+		goto fail;
+	}
+
+	snapshot_enter();
+	snap = snapshot_find(&info, flags);
+	if(snap != NULL)
+		snap->users++;
+	snapshot_leave();
+
+	// Nobody has this version yet, so we parse it ourselves.
+	// The cache isn't locked while we do, so if someone else
+	// beats us to it, we use theirs and throw ours away.
+	//
+	// Values are all trimmed now, as handles in other threads
+	// may use them at the same time.
+	if(snap == NULL)
+	{
+		CONFIG *parsed = config_fdopen_flags(fd, (flags & ~CONFIG_LAZY));
+		if(parsed == NULL)
+		{
+			int err = errno;
+			close(fd);
+			errno = err;
+			goto fail;
+		}
+
+		int state = config_read(parsed);
+		int err = errno;
+
+		close(parsed->fd);
+		parsed->fd = -1;
+
+		if(state == -1)
+		{
+			config_free(parsed);
+			errno = err;
+			goto fail;
+		}
+
+		size_t path_len = strlen(path);
+		struct config_snapshot *fresh = mem_alloc(&default_allocator, (sizeof(struct config_snapshot) + path_len + 1));
+		if(fresh == NULL)
+		{
+			config_free(parsed);
+			goto fail;
+		}
+
+		fresh->cfg = parsed;
+		fresh->dev = info.st_dev;
+		fresh->ino = info.st_ino;
+		fresh->mtime = info.st_mtim;
+		fresh->size = info.st_size;
+		fresh->flags = flags;
+		fresh->users = 1;
+		fresh->stale = 0;
+		fresh->alloc = default_allocator;
+		fresh->path_len = path_len;
+		memcpy(fresh->path, path, (path_len + 1));
+
+		snapshot_enter();
+		snap = snapshot_find(&info, flags);
+		if(snap != NULL)
+			snap->users++;
+		else
+		{
+			snap = fresh;
+			snap->next = snapshot_list;
+			snapshot_list = snap;
+			snapshot_expire(snap, &dead);
+		}
+		snapshot_leave();
+
+		if(snap != fresh)
+			snapshot_free(fresh);
+
+		while(dead != NULL)
+		{
+			struct config_snapshot *next = dead->next;
+			snapshot_free(dead);
+			dead = next;
+		}
+	}
+	else
+		close(fd);
+
+	init = mem_alloc(&default_allocator, sizeof(CONFIG));
+	if(init == NULL)
+		goto fail;
+
+	if(config_init(init, -1, (flags & ~CONFIG_LAZY)) == -1)
+	{
+		mem_free(&default_allocator, init, sizeof(CONFIG));
+		init = NULL;
+		goto fail;
+	}
+
+	init->snapshot = snap;
+	init->key_list = snap->cfg->key_list;
+	init->key_current = &init->key_list;
+
+	set_sigmask(SIGMASK_RST);
+	return init;
+
+	fail:
+		if(snap != NULL)
+		{
+			int err = errno;
+			snapshot_put(snap);
+			errno = err;
+		}
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+}
+
+// Sets the allocator used by 'cfg', or, if 'cfg' is NULL, the
+// allocator used for every CONFIG made after this.
+// A NULL 'alloc' goes back to malloc() and friends.
+// Memory can't change hands, so 'cfg' mustn't hold any yet.
+int config_set_allocator(CONFIG *restrict cfg, const struct config_allocator *restrict alloc)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(alloc == NULL)
+		alloc = &std_allocator;
+
+	if(alloc->alloc == NULL || alloc->resize == NULL || alloc->release == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL)
+	{
+		default_allocator = *alloc;
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+
+	if(cfg->key_list != NULL || cfg->key_spare != NULL || cfg->key_build != NULL ||
+	   cfg->buff != NULL || cfg->key_sorted != NULL || cfg->values != NULL ||
+	   cfg->value_slots != NULL || cfg->entries != NULL || cfg->image != NULL ||
+	   cfg->subs != NULL || cfg->sub_slots != NULL || cfg->snapshot != NULL ||
+	   cfg->packed != NULL ||
+	   atomic_load(&cfg->overrides) != NULL)
+	{
+		errno = EBUSY;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	cfg->alloc = *alloc;
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+// Sets the limits every read of 'cfg' is held to, from the next
+// read on.
+// A limit of 0 turns that limit off.
+int config_set_limits(CONFIG *restrict cfg, size_t max_bytes, size_t max_entries, size_t max_line, size_t max_value)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	// What we've counted so far would no longer add up.
+	if(cfg->reading)
+	{
+		errno = EBUSY;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	cfg->max_bytes = max_bytes;
+	cfg->max_entries = max_entries;
+	cfg->max_line = max_line;
+	cfg->max_value = max_value;
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+// If 'cfg' was opened on a non-blocking descriptor, this may
+// return -1 with errno set to EAGAIN before the whole file has
+// arrived.
+// Everything read so far is kept, and calling it again once
+// there's more to read carries on where it left off.
+int config_read(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || cfg->fd < 0)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->reading && (cfg->flags & CONFIG_APPEND))
+	{
+		if(append_begin(cfg) == -1)
+			goto fail;
+	}
+	else if(!cfg->reading)
+		read_begin(cfg);
+
+	ssize_t state;
+
+	if(cfg->flags & CONFIG_LAZY)
+	{
+		// In lazy mode we read straight into the buffer that
+		// we'll keep, starting with room for the whole file
+		// when we know how big it is.
+		struct stat info;
+
+		// The extra byte lets the read that finds the end of
+		// the file happen without growing the buffer.
+		if(cfg->buff_pos == 0 && fstat(cfg->fd, &info) == 0 && S_ISREG(info.st_mode))
+		{
+			// A file that's already too big fails before we
+			// allocate anything for it.
+			if(cfg->max_bytes > 0 && (uintmax_t)info.st_size > cfg->max_bytes)
+			{
+				errno = EFBIG;
+				goto fail;
+			}
+
+			if(buff_reserve(cfg, (info.st_size + 1)) == -1)
+				goto fail;
+		}
+
+		while(1)
+		{
+			if(buff_reserve(cfg, 1) == -1)
+				goto fail;
+
+			state = read(cfg->fd, (cfg->buff + cfg->buff_pos), (cfg->buff_size - cfg->buff_pos));
+			if(state == -1 && errno == EINTR)
+				continue;
+			else if(state == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				goto again;
+			else if(state == -1)
+				goto fail;
+			else if(state == 0)
+				break;
+
+			if(limit_input(cfg, (cfg->buff + cfg->buff_pos), state) == -1)
+				goto fail;
+
+			cfg->buff_pos += state;
+		}
+	}
+	else
+	{
+		if(cfg->buff == NULL)
+		{
+			// We'll allow people to choose whether they want to 
+			// use a minimum buffer size.
+			//
+			// Depending on the envinronment, this may or may not
+			// be useful.
+			#ifdef NO_MIN_BUFF
+			cfg->buff_size = cfg->block_size;
+			#else
+			if(cfg->block_size < BUFF_MIN)
+				cfg->buff_size = BUFF_MIN;
+			else
+				cfg->buff_size = cfg->block_size;
+			#endif		
+
+			// I was using this line to debug issues with parsing
+			// between buffers.
+			// I'll leave it here for now.
+			// 			-Luna
+			//cfg->buff_size = 32;
+
+			cfg->buff = mem_alloc(&cfg->alloc, (cfg->buff_size + 1));
+			if(cfg->buff == NULL)
+				goto fail;
+		}
+
+		while(1)
+		{
+			state = read(cfg->fd, cfg->buff, cfg->buff_size);
+			if(state == -1 && errno == EINTR)
+				continue;
+			else if(state == -1 && (errno == EAGAIN || errno == EWOULDBLOCK))
+				goto again;
+			else if(state == -1)
+				goto fail;
+			else if(state == 0)
+				break;
+
+			if(read_chunk(cfg, cfg->buff, state) == -1)
+				goto fail;
+		}
+	}
+
+	if(read_end(cfg) == -1)
+		goto fail;
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+
+	// Not an error as such, so we keep everything we've got.
+	again:
+		set_sigmask(SIGMASK_RST);
+		return -1;
+
+	fail:
+		set_sigmask(SIGMASK_RST);
+		read_reset(cfg);
+		return -1;
+}
+
+// The feed functions let the caller supply the input, for
+// when it comes from somewhere we shouldn't block on, like a
+// socket in an event loop.
+// The chunks can be any size, and split the file anywhere.
+int config_feed(CONFIG *restrict cfg, const char *restrict data, size_t len)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || (data == NULL && len > 0))
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->reading)
+		read_begin(cfg);
+
+	if(read_chunk(cfg, data, len) == -1)
+	{
+		read_reset(cfg);
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+int config_feed_end(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->reading)
+		read_begin(cfg);
+
+	if(read_end(cfg) == -1)
+	{
+		read_reset(cfg);
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+// Opens, reads, and finishes a configuration in one go, for
+// configurations that are read once and kept for a long time.
+CONFIG *config_load(const char *restrict path, int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	CONFIG *cfg = config_open_flags(path, flags);
+	if(cfg == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	if(config_read(cfg) == -1 || config_finish(cfg) == -1)
+	{
+		int err = errno;
+		config_close(cfg);
+		errno = err;
+
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return cfg;
+}
+
+// Gives back everything 'cfg' only needed for reading; its
+// descriptor, its read buffer, its spare keys, and its index.
+// The keylist itself is packed into one block of exactly the
+// size it needs.
+//
+// The keylist is rewound, as its keys have all moved.
+int config_finish(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || cfg->reading || cfg->key_current == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg->fd >= 0)
+	{
+		if(close(cfg->fd) != 0)
+		{
+			set_sigmask(SIGMASK_RST);
+			return -1;
+		}
+
+		cfg->fd = -1;
+	}
+
+	// The keys of images and snapshots are already packed, and
+	// belong to someone else.
+	// Pooled keys are already as small as they'll get, and
+	// packing them would only make copies of shared strings.
+	if(cfg->image == NULL && cfg->snapshot == NULL && cfg->packed == NULL && cfg->pool == NULL)
+	{
+		size_t count;
+		size_t size = pack_size(cfg, &count);
+		k_list *nodes = NULL;
+
+		size += count * sizeof(k_list);
+
+		if(count > 0)
+		{
+			nodes = mem_alloc(&cfg->alloc, size);
+			if(nodes == NULL)
+			{
+				set_sigmask(SIGMASK_RST);
+				return -1;
+			}
+
+			cfg->tag_value[0] = '\n';
+			cfg->tag_value[1] = '\0';
+
+			pack_write(cfg, nodes, (char *)(nodes + count), count, cfg->tag_value);
+		}
+
+		// This also marks anything that pointed at the old keys
+		// out of date.
+		read_reset(cfg);
+
+		cfg->key_list = nodes;
+		cfg->key_tail = (nodes != NULL) ? &nodes[count - 1].key_next : &cfg->key_list;
+		cfg->packed = nodes;
+		cfg->packed_size = (nodes != NULL) ? size : 0;
+	}
+
+	list_free(cfg, &cfg->key_spare);
+
+	mem_free(&cfg->alloc, cfg->buff, (cfg->buff_size + 1));
+	cfg->buff = NULL;
+	cfg->buff_size = 0;
+	cfg->buff_pos = 0;
+
+	index_free(cfg);
+	mem_free(&cfg->alloc, cfg->key_sorted, (cfg->key_sorted_size * 2 * sizeof(k_list *)));
+	cfg->key_sorted = NULL;
+	cfg->key_sorted_size = 0;
+	mem_free(&cfg->alloc, cfg->values, (cfg->values_size * sizeof(char *)));
+	cfg->values = NULL;
+	cfg->values_size = 0;
+	if(cfg->value_slots != NULL)
+		mem_free(&cfg->alloc, cfg->value_slots, ((cfg->value_mask + 1) * sizeof(struct value_slot)));
+	cfg->value_slots = NULL;
+	cfg->value_mask = 0;
+	mem_free(&cfg->alloc, cfg->entries, (cfg->entries_size * sizeof(struct config_entry)));
+	cfg->entries = NULL;
+	cfg->entries_size = 0;
+
+	key_rewind(cfg);
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+int config_rewind(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return 0;
+
+	if(cfg == NULL || key_none(cfg))
+	{  
+		errno = EINVAL;
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+
+	key_rewind(cfg);
+
+	set_sigmask(SIGMASK_RST);
+	return 1;
+}
+
+int config_close(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return 0;
+
+	if(cfg == NULL)
+	{
+		errno = EINVAL;
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	
+	// Should this be "free and close", or "close and free"?
+	// Either way, if close() fails, we're left in an 
+	// undefined state.
+	// 			-Luna
+	if(cfg->fd >= 0 && close(cfg->fd) != 0)
+	{
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	config_free(cfg);
+
+	set_sigmask(SIGMASK_RST);
+	return 1;
+}
+
+// I now remember why these functions return -1 on error. By 
+// returning -1 for error, 0 for the end of list, 1 for 
+// sucess, and greater than 1 to indicate a truncated data
+// buffer, we can quickly get some idea what's happening.
+//
+// Looking back over it more closely, that's actually pretty
+// obvious.
+// 			-Luna
+int config_index(CONFIG *restrict cfg, char *restrict name, char *restrict data_buff, unsigned int buff_size, unsigned int index)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data_buff == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || key_none(cfg))
+	{
+		name[0] = '\0';
+		data_buff[0] = '\0';
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list *tmp;
+	k_list view;
+
+	tmp = key_index(cfg, index, &view);
+	if(tmp == NULL)
+	{
+		name[0] = '\0';
+		data_buff[0] = '\0';
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		copy_name(name, tmp);
+		int state = copy_value(data_buff, buff_size, tmp);
+
+		set_sigmask(SIGMASK_RST);
+		return state;
+	}
+}
+
+int config_search(CONFIG *restrict cfg, const char *restrict name, char *restrict data_buff, unsigned int buff_size)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || cfg->key_current == NULL || name == NULL)
+	{
+		if(data_buff != NULL)
+			data_buff[0] = '\0';
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	struct override_map *map;
+	unsigned int epoch;
+	k_list view;
+	const k_list *key = key_search(cfg, name, strlen(name), &map, &epoch, &view);
+
+	if(key == NULL)
+	{
+		override_leave(cfg, map, epoch);
+
+		if(data_buff != NULL)
+			data_buff[0] = '\0';
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		int state = 1;
+
+		if(data_buff != NULL)
+			state = copy_value(data_buff, buff_size, key);
+
+		override_leave(cfg, map, epoch);
+
+		set_sigmask(SIGMASK_RST);
+		return state;
+	}
+}
+
+int config_next(CONFIG *restrict cfg, char *restrict name, char *restrict data_buff, unsigned int buff_size)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data_buff == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || cfg->key_current == NULL)
+	{
+		name[0] = '\0';
+		data_buff[0] = '\0';
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list view;
+	k_list *key = key_here(cfg, &view);
+
+	if(key == NULL)
+	{
+		name[0] = '\0';
+		data_buff[0] = '\0';
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		key_load(key);
+		copy_name(name, key);
+		int state = copy_value(data_buff, buff_size, key);
+
+		key_step(cfg);
+
+		set_sigmask(SIGMASK_RST);
+		return state;
+	}
+}
+
+// The by-reference function were originaly a debug tool, but
+// ended up being useful, so I left them in as a feature.
+// 			-Luna
+int config_index_br(CONFIG *restrict cfg, char **restrict name, char **restrict data, unsigned int index)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || key_none(cfg))
+	{
+		*name = NULL;
+		*data = NULL;
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list *tmp;
+	k_list view;
+
+	tmp = key_index(cfg, index, &view);
+	if(tmp == NULL)
+	{
+		*name = NULL;
+		*data = NULL;
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		*name = tmp->name;
+		*data = tmp->value;
+
+		set_sigmask(SIGMASK_RST);
+		return 1;
+	}
+}
+
+int config_search_br(CONFIG *restrict cfg, const char *restrict name, char **restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || cfg->key_current == NULL || key_end(cfg) || name == NULL)
+	{
+		if(data != NULL)
+			*data = NULL;
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+	
+	struct override_map *map;
+	unsigned int epoch;
+	k_list view;
+	const k_list *key = key_search(cfg, name, strlen(name), &map, &epoch, &view);
+
+	if(data != NULL)
+		*data = (key != NULL) ? key->value : NULL;
+
+	override_leave(cfg, map, epoch);
+
+	set_sigmask(SIGMASK_RST);
+	return (key != NULL);
+}
+
+int config_next_br(CONFIG *restrict cfg, char **restrict name, char **restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || cfg->key_current == NULL)
+	{
+		*name = NULL;
+		*data = NULL;
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list view;
+	k_list *key = key_here(cfg, &view);
+
+	if(key == NULL)
+	{
+		*name = NULL;
+		*data = NULL;
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		key_load(key);
+		*name = key->name;
+		*data = key->value;
+		key_step(cfg);
+
+		set_sigmask(SIGMASK_RST);
+		return 1;
+	}
+}
+
+
+// The string-view functions are the same as the by-reference
+// functions, but also hand back the lengths we stored while
+// reading, so callers never need to strlen() what we return.
+int config_index_sv(CONFIG *restrict cfg, config_sv *restrict name, config_sv *restrict data, unsigned int index)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || key_none(cfg))
+	{
+		*name = (config_sv){NULL, 0};
+		*data = (config_sv){NULL, 0};
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list *tmp;
+	k_list view;
+
+	tmp = key_index(cfg, index, &view);
+	if(tmp == NULL)
+	{
+		*name = (config_sv){NULL, 0};
+		*data = (config_sv){NULL, 0};
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		*name = (config_sv){tmp->name, tmp->name_len};
+		*data = (config_sv){tmp->value, tmp->value_len};
+
+		set_sigmask(SIGMASK_RST);
+		return 1;
+	}
+}
+
+// Note that 'name' is passed as a string-view too, so it
+// doesn't need to be terminated.
+int config_search_sv(CONFIG *restrict cfg, config_sv name, config_sv *restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || cfg->key_current == NULL || key_end(cfg) || name.ptr == NULL)
+	{
+		if(data != NULL)
+			*data = (config_sv){NULL, 0};
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	struct override_map *map;
+	unsigned int epoch;
+	k_list view;
+	const k_list *key = key_search(cfg, name.ptr, name.len, &map, &epoch, &view);
+
+	if(data != NULL)
+	{
+		if(key != NULL)
+			*data = (config_sv){key->value, key->value_len};
+		else
+			*data = (config_sv){NULL, 0};
+	}
+
+	override_leave(cfg, map, epoch);
+
+	set_sigmask(SIGMASK_RST);
+	return (key != NULL);
+}
+
+// Finds the first value of 'name', or its override, without
+// using the keylist position.
+// Any number of threads may look up keys at once, while others
+// set and unset overrides.
+int config_lookup(CONFIG *restrict cfg, const char *restrict name, char *restrict data_buff, unsigned int buff_size)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name == NULL || cfg->reading)
+	{
+		if(data_buff != NULL)
+			data_buff[0] = '\0';
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	struct override_map *map;
+	unsigned int epoch;
+	k_list view;
+	k_list *key = key_lookup(cfg, name, strlen(name), &map, &epoch, &view);
+	int state = (key != NULL);
+
+	// The value is copied out before we leave the table, so an
+	// override may be freed as soon as we're done.
+	if(data_buff != NULL)
+	{
+		if(key != NULL)
+			state = copy_value(data_buff, buff_size, key_load_shared(key));
+		else
+			data_buff[0] = '\0';
+	}
+
+	override_leave(cfg, map, epoch);
+
+	set_sigmask(SIGMASK_RST);
+	return state;
+}
+
+// The same, by reference.
+// The value of an override found this way lasts until that
+// override is next set or unset.
+int config_lookup_sv(CONFIG *restrict cfg, config_sv name, config_sv *restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name.ptr == NULL || cfg->reading)
+	{
+		if(data != NULL)
+			*data = (config_sv){NULL, 0};
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	struct override_map *map;
+	unsigned int epoch;
+	k_list view;
+	k_list *key = key_lookup(cfg, name.ptr, name.len, &map, &epoch, &view);
+
+	if(data != NULL)
+	{
+		if(key != NULL)
+		{
+			key_load_shared(key);
+			*data = (config_sv){key->value, key->value_len};
+		}
+		else
+			*data = (config_sv){NULL, 0};
+	}
+
+	override_leave(cfg, map, epoch);
+
+	set_sigmask(SIGMASK_RST);
+	return (key != NULL);
+}
+
+// Gives every value of 'name', in the order they were read.
+// The array belongs to 'cfg', and lasts until it's next read.
+int config_values(CONFIG *restrict cfg, const char *restrict name, const char ***restrict out, size_t *restrict count)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(out != NULL)
+		*out = NULL;
+	if(count != NULL)
+		*count = 0;
+
+	if(cfg == NULL || key_none(cfg) || name == NULL || out == NULL || count == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->values_built && (image_nodes(cfg) == -1 || values_build(cfg) == -1))
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	size_t len = strlen(name);
+	uint32_t hash = (cfg->flags & CONFIG_ICASE) ? fold_hash(name, len) : str_hash(name, len);
+	const struct value_slot *slot = value_slot(cfg, name, len, hash);
+
+	if(slot->key == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+
+	*out = (cfg->values + slot->start);
+	*count = slot->count;
+
+	set_sigmask(SIGMASK_RST);
+	return 1;
+}
+
+// Returns the keylist of 'cfg' as an array, for the inline
+// accessors in <libreadconf_inline.h>.
+// Like the array from config_values(), it lasts until 'cfg' is
+// next read.
+const struct config_view *config_view(CONFIG *restrict cfg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	if(cfg == NULL || cfg->key_current == NULL || cfg->reading)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	if(!cfg->view_built && (image_nodes(cfg) == -1 || view_build(cfg) == -1))
+	{
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return &cfg->view;
+}
+
+// Overrides the value of 'name' for the search functions,
+// until it's unset.
+// This may be called while other threads are looking keys up
+// in 'cfg'.
+int config_set(CONFIG *restrict cfg, const char *restrict name, const char *restrict value)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name == NULL || value == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	size_t len = strlen(name);
+	struct override *over = override_new(cfg, name, len, value, strlen(value));
+	if(over == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	#ifndef NO_PTHREAD
+	pthread_mutex_lock(&cfg->override_lock);
+	#endif
+
+	struct override_map *old = atomic_load(&cfg->overrides);
+	struct override *dead = NULL;
+
+	if(old != NULL)
+		dead = old->slots[override_slot(cfg, old, name, len, over->key.name_hash)];
+
+	struct override_map *map = override_copy(cfg, old, ((old != NULL) ? old->count : 0) + 1, dead);
+	if(map == NULL)
+	{
+		#ifndef NO_PTHREAD
+		pthread_mutex_unlock(&cfg->override_lock);
+		#endif
+		override_release(cfg, over);
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	map->slots[override_slot(cfg, map, name, len, over->key.name_hash)] = over;
+	map->count++;
+
+	override_publish(cfg, map, dead);
+
+	#ifndef NO_PTHREAD
+	pthread_mutex_unlock(&cfg->override_lock);
+	#endif
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+// Removes the override of 'name', so the search functions see
+// the value from the file again.
+int config_unset(CONFIG *restrict cfg, const char *restrict name)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	size_t len = strlen(name);
+
+	#ifndef NO_PTHREAD
+	pthread_mutex_lock(&cfg->override_lock);
+	#endif
+
+	struct override_map *old = atomic_load(&cfg->overrides);
+	struct override *dead = NULL;
+
+	if(old != NULL)
+		dead = old->slots[override_slot(cfg, old, name, len, override_hash(cfg, name, len))];
+
+	int state = 0;
+
+	if(dead != NULL)
+	{
+		struct override_map *map = NULL;
+
+		// The last override takes the table with it, so the
+		// search functions go back to not checking at all.
+		if(old->count > 1)
+		{
+			map = override_copy(cfg, old, (old->count - 1), dead);
+			if(map == NULL)
+				state = -1;
+		}
+
+		if(state == 0)
+		{
+			override_publish(cfg, map, dead);
+			state = 1;
+		}
+	}
+
+	#ifndef NO_PTHREAD
+	pthread_mutex_unlock(&cfg->override_lock);
+	#endif
+
+	set_sigmask(SIGMASK_RST);
+	return state;
+}
+
+// Calls 'callback' whenever a read of 'cfg' adds, removes, or
+// changes the items named 'name'.
+// If 'name' is a tag, the keys in its block are covered too.
+int config_subscribe(CONFIG *restrict cfg, const char *restrict name, config_change_fn callback, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name == NULL || callback == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	// Subscriptions keep pointers to keys, so an attached
+	// CONFIG needs a keylist of its own for them.
+	if(image_nodes(cfg) == -1)
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	size_t len = strlen(name);
+	struct config_sub *sub = mem_alloc(&cfg->alloc, (sizeof(struct config_sub) + len + 1));
+	if(sub == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	memcpy(sub->name, name, (len + 1));
+	sub->name_len = len;
+	sub->hash = sub_hash(cfg, name, len);
+	sub->callback = callback;
+	sub->arg = arg;
+	sub->next = NULL;
+	sub->same_next = NULL;
+	sub->print = PRINT_BASIS;
+	sub->count = 0;
+	sub->new_print = PRINT_BASIS;
+	sub->new_count = 0;
+	sub->first = NULL;
+
+	struct config_sub **link = &cfg->subs;
+	for(; *link != NULL; link = &(*link)->next);
+	*link = sub;
+
+	if(sub_table(cfg) == -1)
+	{
+		*link = NULL;
+		mem_free(&cfg->alloc, sub, (sizeof(struct config_sub) + len + 1));
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	// If 'cfg' has already been read, we start from what it
+	// holds now, so only later changes are reported.
+	if(cfg->key_current != NULL && !cfg->reading)
+	{
+		sub_scan(cfg);
+		sub->print = sub->new_print;
+		sub->count = sub->new_count;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+// Removes the subscriptions made with the same 'name',
+// 'callback', and 'arg'.
+// This may be called from a subscription's callback.
+int config_unsubscribe(CONFIG *restrict cfg, const char *restrict name, config_change_fn callback, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || name == NULL || callback == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg->subs == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+
+	size_t len = strlen(name);
+	int found = 0;
+
+	for(struct config_sub *sub = *sub_slot(cfg, name, len, sub_hash(cfg, name, len)); sub != NULL; sub = sub->same_next)
+	{
+		if(sub->callback == callback && sub->arg == arg)
+		{
+			// The list can't change under sub_notify(), so it's
+			// left to sweep up what we've dropped.
+			sub->callback = NULL;
+			found = 1;
+		}
+	}
+
+	if(found && cfg->sub_firing == 0)
+		sub_sweep(cfg);
+
+	set_sigmask(SIGMASK_RST);
+	return found;
+}
+
+int config_next_sv(CONFIG *restrict cfg, config_sv *restrict name, config_sv *restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(name == NULL || data == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(cfg == NULL || cfg->key_current == NULL)
+	{
+		*name = (config_sv){NULL, 0};
+		*data = (config_sv){NULL, 0};
+
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	k_list view;
+	k_list *key = key_here(cfg, &view);
+
+	if(key == NULL)
+	{
+		*name = (config_sv){NULL, 0};
+		*data = (config_sv){NULL, 0};
+
+		set_sigmask(SIGMASK_RST);
+		return 0;
+	}
+	else
+	{
+		key_load(key);
+		*name = (config_sv){key->name, key->name_len};
+		*data = (config_sv){key->value, key->value_len};
+		key_step(cfg);
+
+		set_sigmask(SIGMASK_RST);
+		return 1;
+	}
+}
+
+// The prefix and range functions walk the sorted index, so
+// they never touch keys outside of the requested range, and
+// they don't affect the keylist position.
+int config_prefix_iter(CONFIG *restrict cfg, const char *restrict prefix, config_iter_fn callback, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || key_none(cfg) || prefix == NULL || callback == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->key_indexed && (image_nodes(cfg) == -1 || index_build(cfg) == -1))
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	int (*ncmp)(const char *, const char *, size_t) = (cfg->flags & CONFIG_ICASE) ? fold_ncmp : strncmp;
+	size_t len = strlen(prefix);
+	int count = 0;
+
+	for(size_t i = index_lower(cfg, prefix); i < cfg->key_count; i++)
+	{
+		k_list *tmp = cfg->key_sorted[i];
+
+		if(ncmp(tmp->name, prefix, len) != 0)
+			break;
+
+		count++;
+		if(callback(tmp->name, key_load(tmp)->value, arg) != 0)
+			break;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return count;
+}
+
+int config_range_iter(CONFIG *restrict cfg, const char *restrict first, const char *restrict last, config_iter_fn callback, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || key_none(cfg) || first == NULL || callback == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	if(!cfg->key_indexed && (image_nodes(cfg) == -1 || index_build(cfg) == -1))
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	int (*cmp)(const char *, const char *) = (cfg->flags & CONFIG_ICASE) ? fold_cmp : strcmp;
+	int count = 0;
+
+	for(size_t i = index_lower(cfg, first); i < cfg->key_count; i++)
+	{
+		k_list *tmp = cfg->key_sorted[i];
+
+		if(last != NULL && cmp(tmp->name, last) >= 0)
+			break;
+
+		count++;
+		if(callback(tmp->name, key_load(tmp)->value, arg) != 0)
+			break;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return count;
+}
+
+/*
+ * Here we start on binding a keylist to a structure.
+ */
+
+// Converts the value of 'key' and stores it in the member of
+// 'out' described by 'field'.
+// Returns -1 if the value can't be converted.
+static int bind_store(const struct config_field *restrict field, const k_list *restrict key, void *restrict out)
+{
+	char *dest = (char *)out + field->offset;
+	char *end;
+	long lval;
+	unsigned long ulval;
+	double dval;
+
+	errno = 0;
+
+	switch(field->type)
+	{
+		case CONFIG_TYPE_STRING:
+			*(char **)dest = key->value;
+			return 0;
+
+		case CONFIG_TYPE_BUFF:
+			if(field->size == 0)
+				return -1;
+			copy_value(dest, field->size, key);
+			return 0;
+
+		case CONFIG_TYPE_SV:
+			*(config_sv *)dest = (config_sv){key->value, key->value_len};
+			return 0;
+
+		case CONFIG_TYPE_INT:
+		case CONFIG_TYPE_LONG:
+			lval = strtol(key->value, &end, 0);
+			if(key->value_len == 0 || *end != '\0' || errno != 0)
+				return -1;
+			if(field->type == CONFIG_TYPE_LONG)
+				*(long *)dest = lval;
+			else if(lval < INT_MIN || lval > INT_MAX)
+				return -1;
+			else
+				*(int *)dest = lval;
+			return 0;
+
+		case CONFIG_TYPE_UINT:
+		case CONFIG_TYPE_ULONG:
+			// strtoul() happily negates "-1", which isn't what
+			// anyone means by an unsigned value.
+			if(key->value[0] == '-')
+				return -1;
+			ulval = strtoul(key->value, &end, 0);
+			if(key->value_len == 0 || *end != '\0' || errno != 0)
+				return -1;
+			if(field->type == CONFIG_TYPE_ULONG)
+				*(unsigned long *)dest = ulval;
+			else if(ulval > UINT_MAX)
+				return -1;
+			else
+				*(unsigned int *)dest = ulval;
+			return 0;
+
+		case CONFIG_TYPE_DOUBLE:
+			dval = strtod(key->value, &end);
+			if(key->value_len == 0 || *end != '\0' || errno != 0)
+				return -1;
+			*(double *)dest = dval;
+			return 0;
+
+		case CONFIG_TYPE_BOOL:
+			if(fold_cmp(key->value, "true") == 0 || fold_cmp(key->value, "yes") == 0
+				|| fold_cmp(key->value, "on") == 0 || strcmp(key->value, "1") == 0)
+				*(_Bool *)dest = 1;
+			else if(fold_cmp(key->value, "false") == 0 || fold_cmp(key->value, "no") == 0
+				|| fold_cmp(key->value, "off") == 0 || strcmp(key->value, "0") == 0)
+				*(_Bool *)dest = 0;
+			else
+				return -1;
+			return 0;
+
+		default:
+			return -1;
+	}
+}
+
+// The field table is sorted by name once per call, so each key
+// in the keylist costs a single binary search.
+//
+// Field tables are short, and usually written in some sort of
+// order already, so an insertion sort does just fine.
+static void bind_sort(const struct config_field **restrict order, size_t count, int (*cmp)(const char *, const char *))
+{
+	for(size_t i = 1; i < count; i++)
+	{
+		const struct config_field *tmp = order[i];
+		size_t j = i;
+
+		for(; j > 0 && cmp(order[j - 1]->name, tmp->name) > 0; j--)
+			order[j] = order[j - 1];
+
+		order[j] = tmp;
+	}
+}
+
+static const struct config_field *bind_find(const struct config_field **restrict order, size_t count, const char *restrict name, int (*cmp)(const char *, const char *))
+{
+	size_t lo = 0, hi = count;
+
+	while(lo < hi)
+	{
+		size_t mid = lo + (hi - lo) / 2;
+		int state = cmp(order[mid]->name, name);
+
+		if(state == 0)
+			return order[mid];
+		else if(state < 0)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+
+	return NULL;
+}
+
+int config_bind(CONFIG *restrict cfg, const struct config_field fields[], size_t count, void *out)
+{
+	return config_bind_report(cfg, fields, count, out, NULL, NULL);
+}
+
+// Keys are bound in a single pass over the keylist.
+// The first occurrence of a key wins, just as it would with
+// config_rewind() and config_search(), and items that aren't
+// keys (tags) are skipped.
+//
+// Fields that were never seen are reported once the pass is
+// done, using the flags we set along the way, not by going
+// back over the list.
+int config_bind_report(CONFIG *restrict cfg, const struct config_field fields[], size_t count, void *out, config_report_fn report, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || (fields == NULL && count > 0) || out == NULL)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	size_t order_size = count * (sizeof(struct config_field *) + 1) + 1;
+	const struct config_field **order = mem_alloc(&cfg->alloc, order_size);
+	if(order == NULL)
+	{
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	char *seen = (char *)(order + count);
+	int (*cmp)(const char *, const char *) = (cfg->flags & CONFIG_ICASE) ? fold_cmp : strcmp;
+	int bound = 0, missing = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		order[i] = &fields[i];
+		seen[i] = 0;
+	}
+
+	bind_sort(order, count, cmp);
+
+	k_list view;
+	size_t pos = 0;
+
+	for(k_list *key = key_walk(cfg, NULL, &pos, &view); key != NULL; key = key_walk(cfg, key, &pos, &view))
+	{
+		if(key->value_len == 1 && key->value[0] == '\n')
+			continue;
+
+		const struct config_field *field = bind_find(order, count, key->name, cmp);
+		if(field == NULL)
+		{
+			if(report != NULL)
+				report(CONFIG_BIND_UNKNOWN, key->name, key_load(key)->value, arg);
+			continue;
+		}
+
+		if(seen[field - fields])
+			continue;
+		seen[field - fields] = 1;
+
+		if(bind_store(field, key_load(key), out) == -1)
+		{
+			if(report != NULL)
+				report(CONFIG_BIND_INVALID, key->name, key->value, arg);
+		}
+		else
+			bound++;
+	}
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(seen[i])
+			continue;
+
+		if(fields[i].flags & CONFIG_FIELD_REQUIRED)
+			missing++;
+		if(report != NULL)
+			report(CONFIG_BIND_MISSING, fields[i].name, NULL, arg);
+	}
+
+	mem_free(&cfg->alloc, order, order_size);
+
+	if(missing > 0)
+	{
+		errno = ENOENT;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return bound;
+}
+
+/*
+ * Here we start on mapping a keylist to the slots of a schema.
+ *
+ * The schema, and the perfect hash behind its slot function,
+ * are written ahead of time by libreadconf-schema, so all we
+ * have to do here is ask it where each key goes.
+ */
+
+int config_map(CONFIG *restrict cfg, const struct config_schema *restrict schema, config_sv slots[])
+{
+	return config_map_report(cfg, schema, slots, NULL, NULL);
+}
+
+// Keys are mapped in a single pass over the keylist.
+// As with config_bind(), the first occurrence of a key wins,
+// and tags are skipped.
+int config_map_report(CONFIG *restrict cfg, const struct config_schema *restrict schema, config_sv slots[], config_report_fn report, void *arg)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(cfg == NULL || schema == NULL || schema->slot == NULL || (slots == NULL && schema->count > 0))
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
+
+	int mapped = 0;
+
+	for(size_t i = 0; i < schema->count; i++)
+	{
+		slots[i].ptr = NULL;
+		slots[i].len = 0;
+	}
+
+	k_list view;
+	size_t pos = 0;
+
+	for(k_list *key = key_walk(cfg, NULL, &pos, &view); key != NULL; key = key_walk(cfg, key, &pos, &view))
+	{
+		if(key->value_len == 1 && key->value[0] == '\n')
+			continue;
+
+		int slot = schema->slot(key->name, key->name_len);
+		if(slot < 0 || (size_t)slot >= schema->count)
+		{
+			if(report != NULL)
+				report(CONFIG_BIND_UNKNOWN, key->name, key_load(key)->value, arg);
+			continue;
+		}
+
+		if(slots[slot].ptr != NULL)
+			continue;
+
+		key_load(key);
+		slots[slot].ptr = key->value;
+		slots[slot].len = key->value_len;
+		mapped++;
+	}
+
+	if(report != NULL)
+	{
+		for(size_t i = 0; i < schema->count; i++)
+		{
+			if(slots[i].ptr == NULL)
+				report(CONFIG_BIND_MISSING, (schema->names != NULL) ? schema->names[i] : NULL, NULL, arg);
+		}
+	}
+
+	set_sigmask(SIGMASK_RST);
+	return mapped;
+}
+
+/*
+ * Here we start on opening many configurations at once.
+ */
+
+struct open_batch
+{
+	const char *const  *paths;
+	CONFIG            **out;
+	int                *errs;
+	size_t              count;
+	int                 flags;
+	int                 ringed;
+	#ifndef NO_PTHREAD
+	atomic_size_t       next;
+	atomic_int          loaded;
+	#else
+	size_t              next;
+	int                 loaded;
+	#endif
+};
+
+// Stores the result for a single file of a batch.
+// Errors are kept with the file they belong to, rather than
+// stopping the batch.
+static void open_done(struct open_batch *restrict batch, size_t i, CONFIG *restrict cfg, int err)
+{
+	batch->out[i] = cfg;
+	if(batch->errs != NULL)
+		batch->errs[i] = err;
+	if(cfg != NULL)
+		batch->loaded++;
+}
+
+// Opens and reads a single file of a batch.
+static void open_one(struct open_batch *restrict batch, size_t i)
+{
+	int err = 0;
+	CONFIG *cfg = config_open_flags(batch->paths[i], batch->flags);
+
+	if(cfg == NULL)
+		err = errno;
+	else if(config_read(cfg) == -1)
+	{
+		err = errno;
+		config_close(cfg);
+		cfg = NULL;
+	}
+
+	open_done(batch, i, cfg, err);
+}
+
+// Each worker takes the next unclaimed file until none are
+// left, so a few large files don't hold up the rest.
+static void open_rest(struct open_batch *restrict batch)
+{
+	size_t i;
+
+	while((i = batch->next++) < batch->count)
+		open_one(batch, i);
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Where the kernel has io_uring, each thread of a batch keeps
+ * a ring of its own, and works through its files a few dozen
+ * at a time. The opens of all of them go to the kernel in a
+ * single call, then their sizes, then each round of reads, so
+ * a thread makes a handful of system calls for every few dozen
+ * files, rather than several for each one.
+ *
+ * We talk to the kernel directly, rather than through liburing,
+ * so there's nothing more to link against.
+ */
+
+struct ring
+{
+	int                  fd;
+	unsigned int         pending;
+	unsigned int        *sq_tail;
+	unsigned int        *sq_mask;
+	unsigned int        *sq_array;
+	unsigned int        *cq_head;
+	unsigned int        *cq_tail;
+	unsigned int        *cq_mask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+	void                *sq_map;
+	void                *cq_map;
+	size_t               sq_size;
+	size_t               cq_size;
+	size_t               sqes_size;
+};
+
+// A file that's part way through being opened and read.
+struct ring_file
+{
+	size_t              index;
+	int                 fd;
+	int                 err;
+	int                 done;
+	CONFIG             *cfg;
+	char               *buff;
+	size_t              buff_size;
+	uint64_t            offset;
+	struct statx        info;
+};
+
+static void ring_free(struct ring *restrict ring)
+{
+	if(ring->sqes != NULL)
+		munmap(ring->sqes, ring->sqes_size);
+	if(ring->cq_map != NULL && ring->cq_map != ring->sq_map)
+		munmap(ring->cq_map, ring->cq_size);
+	if(ring->sq_map != NULL)
+		munmap(ring->sq_map, ring->sq_size);
+
+	close(ring->fd);
+}
+
+// Checks that the kernel can do everything we ask of it.
+// Rings were added before some of the operations we use, so
+// having one isn't enough.
+static int ring_probe(int fd)
+{
+	static const int ops[] = {IORING_OP_OPENAT, IORING_OP_STATX, IORING_OP_READ};
+	size_t size = sizeof(struct io_uring_probe) + (256 * sizeof(struct io_uring_probe_op));
+	struct io_uring_probe *probe = mem_zalloc(&default_allocator, size);
+	int state = 0;
+
+	if(probe == NULL)
+		return 0;
 
-	for(position = 0; key->value[position] != '\0'; position++)
+	if(syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE, probe, 256) == 0)
 	{
-		if(!is_whitespace(key->value[position]) && start == -1)
+		state = 1;
+
+		for(size_t i = 0; i < (sizeof(ops) / sizeof(ops[0])); i++)
 		{
-			start = position;
-			end = position + 1;
+			if(ops[i] > probe->last_op || !(probe->ops[ops[i]].flags & IO_URING_OP_SUPPORTED))
+				state = 0;
 		}
-		else if(!is_whitespace(key->value[position]))
-			end = position + 1;
 	}
 
-	if(start > 0)
+	mem_free(&default_allocator, probe, size);
+	return state;
+}
+
+// Sets up a ring with room for 'entries' requests at once.
+// Fails if the kernel doesn't have io_uring, or won't let us
+// use it, as some sandboxes don't.
+static int ring_init(struct ring *restrict ring, unsigned int entries)
+{
+	struct io_uring_params params;
+
+	memset(&params, 0, sizeof(params));
+	memset(ring, 0, sizeof(*ring));
+
+	ring->fd = syscall(__NR_io_uring_setup, entries, &params);
+	if(ring->fd < 0)
+		return -1;
+
+	if(!ring_probe(ring->fd))
+	{
+		close(ring->fd);
+		errno = ENOSYS;
+		return -1;
+	}
+
+	ring->sq_size = params.sq_off.array + (params.sq_entries * sizeof(unsigned int));
+	ring->cq_size = params.cq_off.cqes + (params.cq_entries * sizeof(struct io_uring_cqe));
+	ring->sqes_size = params.sq_entries * sizeof(struct io_uring_sqe);
+
+	// Newer kernels map both queues together.
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+	{
+		if(ring->cq_size > ring->sq_size)
+			ring->sq_size = ring->cq_size;
+		ring->cq_size = ring->sq_size;
+	}
+
+	ring->sq_map = mmap(NULL, ring->sq_size, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), ring->fd, IORING_OFF_SQ_RING);
+	if(ring->sq_map == MAP_FAILED)
 	{
-		memmove(key->value, (key->value + start), (end - start));
-		key->value[end - start] = '\0';
+		ring->sq_map = NULL;
+		goto fail;
 	}
-	else if(start < 0)
-		is_empty = 1;
+
+	if(params.features & IORING_FEAT_SINGLE_MMAP)
+		ring->cq_map = ring->sq_map;
 	else
-		key->value[end - start] = '\0';
+	{
+		ring->cq_map = mmap(NULL, ring->cq_size, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), ring->fd, IORING_OFF_CQ_RING);
+		if(ring->cq_map == MAP_FAILED)
+		{
+			ring->cq_map = NULL;
+			goto fail;
+		}
+	}
 
-	char *tmp;
-	
-	// Note how we reallocate the 'name' element of the list item
-	// This should save space, but may just result in extra work
-	// in some cases.
-	//
-	// Should we include a directive to skip this step?
-	if(is_empty && !is_key)
+	ring->sqes = mmap(NULL, ring->sqes_size, (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_POPULATE), ring->fd, IORING_OFF_SQES);
+	if(ring->sqes == MAP_FAILED)
+	{
+		ring->sqes = NULL;
+		goto fail;
+	}
+
+	ring->sq_tail = (unsigned int *)((char *)ring->sq_map + params.sq_off.tail);
+	ring->sq_mask = (unsigned int *)((char *)ring->sq_map + params.sq_off.ring_mask);
+	ring->sq_array = (unsigned int *)((char *)ring->sq_map + params.sq_off.array);
+	ring->cq_head = (unsigned int *)((char *)ring->cq_map + params.cq_off.head);
+	ring->cq_tail = (unsigned int *)((char *)ring->cq_map + params.cq_off.tail);
+	ring->cq_mask = (unsigned int *)((char *)ring->cq_map + params.cq_off.ring_mask);
+	ring->cqes = (struct io_uring_cqe *)((char *)ring->cq_map + params.cq_off.cqes);
+
+	return 0;
+
+	fail:
+		{
+			int err = errno;
+			ring_free(ring);
+			errno = err;
+		}
+		return -1;
+}
+
+// Queues a request for the file at 'slot' of our current set.
+// Only we write the tail, so the kernel sees nothing until
+// ring_run() enters it.
+static struct io_uring_sqe *ring_queue(struct ring *restrict ring, int op, size_t slot)
+{
+	unsigned int tail = *ring->sq_tail + ring->pending;
+	unsigned int index = tail & *ring->sq_mask;
+	struct io_uring_sqe *sqe = &ring->sqes[index];
+
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->opcode = op;
+	sqe->user_data = slot;
+	ring->sq_array[index] = index;
+	ring->pending++;
+
+	return sqe;
+}
+
+// Takes whatever has finished off the completion queue,
+// storing each result in 'results' by slot.
+// Returns how many there were.
+static unsigned int ring_reap(struct ring *restrict ring, int results[])
+{
+	unsigned int head = *ring->cq_head;
+	unsigned int tail = __atomic_load_n(ring->cq_tail, __ATOMIC_ACQUIRE);
+	unsigned int count = 0;
+
+	for(; head != tail; head++, count++)
+	{
+		struct io_uring_cqe *cqe = &ring->cqes[head & *ring->cq_mask];
+
+		results[cqe->user_data] = cqe->res;
+	}
+
+	__atomic_store_n(ring->cq_head, head, __ATOMIC_RELEASE);
+
+	return count;
+}
+
+// Hands everything queued to the kernel, and waits for all of
+// it to finish, storing each result in 'results' by slot.
+//
+// If the kernel won't take anything at all, this returns -1,
+// and the caller falls back to doing it the ordinary way. If it
+// stops taking entries part way, we stop handing them over, wait
+// for what it did take, and fail the rest with its error.
+static int ring_run(struct ring *restrict ring, int results[])
+{
+	unsigned int total = ring->pending;
+	unsigned int start = *ring->sq_tail;
+	unsigned int submitted = 0;
+	unsigned int completed = 0;
+	int err = 0;
+
+	if(total == 0)
+		return 0;
+
+	__atomic_store_n(ring->sq_tail, (start + total), __ATOMIC_RELEASE);
+	ring->pending = 0;
+
+	// Once anything has been handed over, the kernel may still
+	// write to our buffers, so we can't give up until it's all
+	// come back.
+	while(completed < submitted || (err == 0 && submitted < total))
 	{
-		tmp = realloc(key->name, (strlen(key->name) + 3));
-		if (tmp != NULL)
-			key->name = tmp;
+		unsigned int submit = (err == 0) ? (total - submitted) : 0;
+		unsigned int in_flight = submitted - completed;
+		int state = syscall(__NR_io_uring_enter, ring->fd, submit, (in_flight > 0 || submit > 0), IORING_ENTER_GETEVENTS, NULL, 0);
+
+		if(state >= 0)
+		{
+			submitted += state;
+
+			// Nothing taken, and nothing to wait for, would
+			// have us spin.
+			if(state == 0 && submit > 0 && in_flight == 0)
+				err = EAGAIN;
+		}
+		else if(errno == EINTR)
+			;
+		// The kernel is short of room for completions. Taking
+		// them off the queue below is what makes room, so this
+		// is only worth retrying while something is in flight.
+		else if((errno == EBUSY || errno == EAGAIN) && in_flight > 0)
+			;
 		else
-			return -1;
+			err = errno;
 
-		key->value[0] = '\n';
-		key->value[1] = '\0';
+		completed += ring_reap(ring, results);
+	}
+
+	if(submitted == total)
+		return 0;
+
+	// Take back what the kernel never saw, so it isn't handed
+	// over by the next run.
+	for(unsigned int i = submitted; i < total; i++)
+		results[ring->sqes[(start + i) & *ring->sq_mask].user_data] = -err;
+
+	__atomic_store_n(ring->sq_tail, (start + submitted), __ATOMIC_RELEASE);
+
+	if(submitted == 0)
+	{
+		errno = err;
+		return -1;
+	}
+
+	return 0;
+}
+
+// Finishes with a file of the set, successfully or not.
+static void ring_done(struct open_batch *restrict batch, struct ring_file *restrict file)
+{
+	if(file->buff != NULL)
+		mem_free(&default_allocator, file->buff, file->buff_size);
+
+	if(file->err != 0)
+	{
+		if(file->cfg != NULL)
+			config_close(file->cfg);
+		else if(file->fd >= 0)
+			close(file->fd);
+
+		file->cfg = NULL;
+	}
+
+	open_done(batch, file->index, file->cfg, file->err);
+
+	file->buff = NULL;
+	file->done = 1;
+}
+
+// Takes the next set of files from the batch, and opens and
+// reads them all through 'ring'.
+// Returns 0 once there are none left.
+static int ring_set(struct open_batch *restrict batch, struct ring *restrict ring)
+{
+	struct ring_file files[OPEN_RING_FILES];
+	int results[OPEN_RING_FILES];
+	size_t count = 0;
+
+	for(; count < OPEN_RING_FILES; count++)
+	{
+		size_t i = batch->next++;
+		if(i >= batch->count)
+			break;
+
+		files[count].index = i;
+		files[count].fd = -1;
+		files[count].err = 0;
+		files[count].done = 0;
+		files[count].cfg = NULL;
+		files[count].buff = NULL;
+		files[count].buff_size = 0;
+		files[count].offset = 0;
+	}
+
+	if(count == 0)
+		return 0;
+
+	// If the ring itself fails part way, whatever isn't done
+	// yet is finished off the ordinary way.
+	for(size_t i = 0; i < count; i++)
+	{
+		struct io_uring_sqe *sqe = ring_queue(ring, IORING_OP_OPENAT, i);
+
+		sqe->fd = AT_FDCWD;
+		sqe->addr = (uintptr_t)batch->paths[files[i].index];
+		sqe->open_flags = O_RDONLY;
+	}
+
+	if(ring_run(ring, results) == -1)
+		goto fallback;
+
+	size_t active = 0;
+
+	for(size_t i = 0; i < count; i++)
+	{
+		if(results[i] < 0)
+		{
+			files[i].err = -results[i];
+			ring_done(batch, &files[i]);
+			continue;
+		}
+
+		files[i].fd = results[i];
+
+		struct io_uring_sqe *sqe = ring_queue(ring, IORING_OP_STATX, i);
+
+		sqe->fd = files[i].fd;
+		sqe->addr = (uintptr_t)"";
+		sqe->len = STATX_BASIC_STATS;
+		sqe->off = (uintptr_t)&files[i].info;
+		sqe->statx_flags = AT_EMPTY_PATH;
+		active++;
+	}
+
+	if(ring_run(ring, results) == -1)
+		goto fallback;
+
+	// Each file is read into a buffer big enough to take all of
+	// it at once, if it isn't too big, and parsed as it comes,
+	// just as config_read() would.
+	for(size_t i = 0; i < count; i++)
+	{
+		struct ring_file *file = &files[i];
+
+		if(file->done)
+			continue;
+
+		if(results[i] < 0)
+		{
+			file->err = -results[i];
+			ring_done(batch, file);
+			active--;
+			continue;
+		}
+
+		file->cfg = mem_alloc(&default_allocator, sizeof(CONFIG));
+		if(file->cfg == NULL || config_init(file->cfg, -1, batch->flags) == -1)
+		{
+			file->err = errno;
+			if(file->cfg != NULL)
+				mem_free(&default_allocator, file->cfg, sizeof(CONFIG));
+			file->cfg = NULL;
+			ring_done(batch, file);
+			active--;
+			continue;
+		}
+
+		file->cfg->fd = file->fd;
+		file->cfg->block_size = file->info.stx_blksize;
+
+		file->buff_size = file->info.stx_blksize;
+		if(file->info.stx_size + 1 > file->buff_size)
+			file->buff_size = file->info.stx_size + 1;
+		if(file->buff_size > OPEN_RING_READ)
+			file->buff_size = OPEN_RING_READ;
+
+		file->buff = mem_alloc(&default_allocator, file->buff_size);
+		if(file->buff == NULL)
+		{
+			file->err = errno;
+			ring_done(batch, file);
+			active--;
+			continue;
+		}
+
+		if(file->cfg->flags & CONFIG_APPEND)
+		{
+			if(append_begin(file->cfg) == -1)
+			{
+				file->err = errno;
+				ring_done(batch, file);
+				active--;
+				continue;
+			}
+		}
+		else
+			read_begin(file->cfg);
+	}
+
+	while(active > 0)
+	{
+		for(size_t i = 0; i < count; i++)
+		{
+			if(files[i].done)
+				continue;
+
+			struct io_uring_sqe *sqe = ring_queue(ring, IORING_OP_READ, i);
+
+			sqe->fd = files[i].fd;
+			sqe->addr = (uintptr_t)files[i].buff;
+			sqe->len = files[i].buff_size;
+			sqe->off = files[i].offset;
+		}
+
+		if(ring_run(ring, results) == -1)
+			goto fallback;
+
+		for(size_t i = 0; i < count; i++)
+		{
+			struct ring_file *file = &files[i];
+
+			if(file->done)
+				continue;
+
+			// Reads that were interrupted are simply asked for
+			// again in the next round.
+			if(results[i] == -EINTR || results[i] == -EAGAIN)
+				continue;
+
+			if(results[i] < 0)
+				file->err = -results[i];
+			else if(results[i] > 0)
+			{
+				if(read_chunk(file->cfg, file->buff, results[i]) == -1)
+					file->err = errno;
+				else
+				{
+					file->offset += results[i];
+					continue;
+				}
+			}
+			else if(read_end(file->cfg) == -1)
+				file->err = errno;
+
+			ring_done(batch, file);
+			active--;
+		}
+	}
+
+	return 1;
+
+	fallback:
+		for(size_t i = 0; i < count; i++)
+		{
+			if(files[i].done)
+				continue;
+
+			if(files[i].buff != NULL)
+				mem_free(&default_allocator, files[i].buff, files[i].buff_size);
+
+			if(files[i].cfg != NULL)
+				config_close(files[i].cfg);
+			else if(files[i].fd >= 0)
+				close(files[i].fd);
+
+			open_one(batch, files[i].index);
+		}
+
+		return -1;
+}
+
+// Works through the batch with a ring until it's done, or the
+// ring stops working, in which case the rest is left to
+// open_rest().
+static void ring_work(struct open_batch *restrict batch, struct ring *restrict ring)
+{
+	while(ring_set(batch, ring) == 1);
+}
+#endif
+
+#ifndef NO_PTHREAD
+// The entry point of each thread we start.
+// Each one uses a ring of its own, if the calling thread could
+// get one.
+static void *open_worker(void *arg)
+{
+	struct open_batch *batch = arg;
+
+	#ifdef HAVE_IO_URING
+	struct ring ring;
+
+	if(batch->ringed && ring_init(&ring, OPEN_RING_FILES) == 0)
+	{
+		ring_work(batch, &ring);
+		ring_free(&ring);
+	}
+	#endif
+
+	open_rest(batch);
+
+	return NULL;
+}
+#endif
+
+// Opening and reading is almost all waiting on system calls,
+// so we spread the files over a small pool of threads and let
+// the kernel overlap them, and the parsing happens in
+// parallel along the way.
+//
+// Where we can use io_uring, each thread batches its system
+// calls through a ring as well, so we only need a thread for
+// each processor to do the parsing. Otherwise, we use twice
+// as many, so some can parse while others wait.
+//
+// The calling thread works as well, and if we can't start any
+// more threads, it simply does all the work itself.
+int config_open_many(const char *const paths[], size_t count, CONFIG *out[], int errs[], int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if((paths == NULL || out == NULL) && count > 0)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
 	}
-	if(is_empty && is_key)
-	{
-		tmp = realloc(key->name, (strlen(key->name) + 2));
-		if (tmp != NULL)
-			key->name = tmp;
-		else
-			return -1;
 
-		key->value[0] = '\0';
+	struct open_batch batch;
+
+	batch.paths = paths;
+	batch.out = out;
+	batch.errs = errs;
+	batch.count = count;
+	batch.flags = flags;
+	batch.ringed = 0;
+	batch.next = 0;
+	batch.loaded = 0;
+
+	#ifdef HAVE_IO_URING
+	// The calling thread tries for a ring first. If it can't
+	// get one, no other thread will either.
+	struct ring ring;
+
+	if(count > 0 && ring_init(&ring, OPEN_RING_FILES) == 0)
+		batch.ringed = 1;
+	#endif
+
+	#ifndef NO_PTHREAD
+	// Threads started here inherit our signal mask, so they
+	// already have SIGHUP blocked.
+	pthread_t threads[OPEN_THREADS_MAX];
+	size_t started = 0;
+	long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+	size_t wanted = (cpus > 0) ? (size_t)cpus : 1;
+
+	if(!batch.ringed)
+		wanted *= 2;
+
+	if(wanted > OPEN_THREADS_MAX)
+		wanted = OPEN_THREADS_MAX;
+	if(batch.ringed && wanted > (count + OPEN_RING_FILES - 1) / OPEN_RING_FILES)
+		wanted = (count + OPEN_RING_FILES - 1) / OPEN_RING_FILES;
+	else if(wanted > count)
+		wanted = count;
+
+	for(; started + 1 < wanted; started++)
+	{
+		if(pthread_create(&threads[started], NULL, open_worker, &batch) != 0)
+			break;
 	}
-	else
+	#endif
+
+	#ifdef HAVE_IO_URING
+	if(batch.ringed)
 	{
-		tmp = realloc(key->name, (strlen(key->name) + strlen(key->value) + 2));
-		if (tmp != NULL)
-			key->name = tmp;
-		else
-			return -1;
+		ring_work(&batch, &ring);
+		ring_free(&ring);
 	}
+	#endif
 
-	return 0;
+	open_rest(&batch);
+
+	#ifndef NO_PTHREAD
+	for(size_t i = 0; i < started; i++)
+		pthread_join(threads[i], NULL);
+	#endif
+
+	set_sigmask(SIGMASK_RST);
+	return batch.loaded;
 }
 
 /*
- * Here we get into the public functions of the library.
- * This should be the only part most people interact with.
- *
- * If you want descriptions of them, check the manpages.
+ * Here we start on intern pools shared between configurations.
  */
- 
-CONFIG *config_open(const char *restrict path)
+
+CONFIG_POOL *config_pool_create(size_t max_value)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return NULL;
 
-	CONFIG *init = malloc(sizeof(CONFIG));
+	CONFIG_POOL *init = mem_alloc(&default_allocator, sizeof(CONFIG_POOL));
 	if(init == NULL)
 	{
 		set_sigmask(SIGMASK_RST);
 		return NULL;
 	}
 
-	init->fd = open(path, O_RDONLY);
-	if(init->fd < 0)
-		goto fail;
-	// I'm using goto for error handling.
-	// Eat me.
-	// 			-Luna
-	
-	init->block_size = get_block_size(init->fd);
-	if(init->block_size < 0)
-		goto fail;
-
-	init->buff = NULL;
-	init->key_list = NULL;
-	init->key_current = NULL;
-	
-	set_sigmask(SIGMASK_RST);
-	return init;
+	init->alloc = default_allocator;
+	init->table_mask = 63;
+	init->table = mem_zalloc(&init->alloc, ((init->table_mask + 1) * sizeof(struct pool_str *)));
+	if(init->table == NULL)
+	{
+		mem_free(&default_allocator, init, sizeof(CONFIG_POOL));
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
 
-	fail:
+	#ifndef NO_PTHREAD
+	if((errno = pthread_mutex_init(&init->lock, NULL)) != 0)
+	{
+		mem_free(&init->alloc, init->table, ((init->table_mask + 1) * sizeof(struct pool_str *)));
+		mem_free(&default_allocator, init, sizeof(CONFIG_POOL));
 		set_sigmask(SIGMASK_RST);
-		free(init);
 		return NULL;
+	}
+	#endif
+
+	init->max_value = max_value;
+	init->users = 0;
+	init->closed = 0;
+	init->strings = 0;
+	init->refs = 0;
+	init->bytes = sizeof(CONFIG_POOL) + ((init->table_mask + 1) * sizeof(struct pool_str *));
+	init->copies = 0;
+
+	set_sigmask(SIGMASK_RST);
+	return init;
 }
 
-// This one's not quite done, but it's here.
-// We're missing some checking to ensure the we can actually
-// use the descriptor we were passed.
-CONFIG *config_fdopen(int fd)
+// A pool may be closed while CONFIGs still use it, in which
+// case it's freed along with the last of them.
+int config_pool_close(CONFIG_POOL *restrict pool)
 {
 	if(!set_sigmask(SIGMASK_SET))
-		return NULL;
+		return 0;
 
-	int flags = fcntl(fd, F_GETFL);
-	if(flags == -1)
-		return NULL;
-	else if((flags & O_WRONLY))
+	if(pool == NULL || pool->closed)
 	{
-		errno = EBADF;
-		return NULL;
-	}
-
+		errno = EINVAL;
 
-	CONFIG *init = malloc(sizeof(CONFIG));
-	if(init == NULL)
-	{
 		set_sigmask(SIGMASK_RST);
-		return NULL;
+		return 0;
 	}
 
-	init->fd = fd;
+	pool_enter(pool);
+	pool->closed = 1;
+	int last = (pool->users == 0);
+	pool_leave(pool);
 
-	init->block_size = get_block_size(init->fd);
-	if(init->block_size < 0)
-		goto fail;
-	
-	init->buff = NULL;
-	init->key_list = NULL;
-	init->key_current = NULL;
+	if(last)
+		pool_free(pool);
 
 	set_sigmask(SIGMASK_RST);
-	return init;
-
-	fail:
-		set_sigmask(SIGMASK_RST);
-		free(init);
-		return NULL;
+	return 1;
 }
 
-CONFIG *config_reopen(const char *restrict path, CONFIG *cfg)
+// Has 'cfg' keep its names and short values in 'pool', or, if
+// 'pool' is NULL, stop using one.
+// Like the allocator, this has to be chosen before the CONFIG
+// holds any keys, as they'd be holding strings from the old
+// pool.
+int config_set_pool(CONFIG *restrict cfg, CONFIG_POOL *restrict pool)
 {
 	if(!set_sigmask(SIGMASK_SET))
-		return NULL;
+		return -1;
 
-	if(cfg != NULL)
+	if(cfg == NULL || (pool != NULL && pool->closed))
 	{
-		if(close(cfg->fd) != 0)
-		{
-			set_sigmask(SIGMASK_RST);
-			return NULL;
-		}
-		list_free(&cfg->key_list);
-		free(cfg->buff);
-		free(cfg);
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return -1;
 	}
 
-	CONFIG *init = malloc(sizeof(CONFIG));
-	if(init == NULL)
+	if(pool == cfg->pool)
 	{
 		set_sigmask(SIGMASK_RST);
-		return NULL;
+		return 0;
 	}
 
-	init->fd = open(path, O_RDONLY);
-	if(init->fd < 0)
-		goto fail;
-	
-	init->block_size = get_block_size(init->fd);
-	if(init->block_size < 0)
-		goto fail;
+	if(cfg->reading || cfg->image != NULL || cfg->key_list != NULL || cfg->key_spare != NULL || cfg->key_build != NULL)
+	{
+		errno = EBUSY;
+		set_sigmask(SIGMASK_RST);
+		return -1;
+	}
 
-	init->buff = NULL;
-	init->key_list = NULL;
-	init->key_current = NULL;
-	
-	set_sigmask(SIGMASK_RST);
-	return init;
+	pool_detach(cfg);
 
-	fail:
-		set_sigmask(SIGMASK_RST);
-		free(init);
-		return NULL;
+	if(pool != NULL)
+	{
+		pool_enter(pool);
+		pool->users++;
+		pool_leave(pool);
+	}
+
+	cfg->pool = pool;
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
 }
 
-int config_read(CONFIG *restrict cfg)
+// 'saved' compares the memory used by the pool with what a copy
+// of each string for every key would have needed.
+int config_pool_stats(CONFIG_POOL *restrict pool, struct config_pool_stats *restrict stats)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return -1;
 
-	if(cfg == NULL)
+	if(pool == NULL || stats == NULL)
 	{
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
-	
-	// We'll allow people to choose whether they want to 
-	// use a minimum buffer size.
-	//
-	// Depending on the envinronment, this may or may not
-	// be useful.
-	#ifdef NO_MIN_BUFF
-	cfg->buff_size = cfg_block_size;
-	#else
-	if(cfg->block_size < BUFF_MIN)
-		cfg->buff_size = cfg->block_size;
+
+	pool_enter(pool);
+
+	stats->strings = pool->strings;
+	stats->refs = pool->refs;
+	stats->bytes = pool->bytes;
+	stats->saved = (pool->copies > pool->bytes) ? pool->copies - pool->bytes : 0;
+
+	pool_leave(pool);
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
+}
+
+/*
+ * Here we start on stacking configurations in layers.
+ *
+ * The layers still belong to the caller; a stack only holds
+ * pointers to them, and a table with the topmost key of every
+ * name.
+ * The table is rebuilt the first time it's needed after the
+ * stack, or any of its layers, has changed, so a lookup is a
+ * single probe no matter how many layers there are.
+ */
+
+struct stack_layer
+{
+	CONFIG         *cfg;
+	unsigned long   generation;
+};
+
+struct stack_slot
+{
+	k_list         *key;
+	uint32_t        hash;
+};
+
+struct config_stack
+{
+	int                 flags;
+	struct stack_layer *layers;
+	size_t              layer_count;
+	size_t              layer_size;
+	struct stack_slot  *table;
+	size_t              table_mask;
+	struct config_allocator alloc;
+};
+
+static uint32_t stack_hash(const CONFIG_STACK *restrict stack, const char *restrict name, size_t len)
+{
+	if(stack->flags & CONFIG_ICASE)
+		return fold_hash(name, len);
 	else
-		cfg->buff_size = BUFF_MIN;
-	#endif		
+		return str_hash(name, len);
+}
 
-	// I was using this line to debug issues with parsing
-	// between buffers.
-	// I'll leave it here for now.
-	// 			-Luna
-	//cfg->buff_size = 32;
+// Returns the slot holding 'name', or the empty slot where it
+// belongs.
+static struct stack_slot *stack_slot(const CONFIG_STACK *restrict stack, struct stack_slot *restrict table, size_t mask, const char *restrict name, size_t len, uint32_t hash)
+{
+	size_t i = hash & mask;
 
-	cfg->buff = malloc(cfg->buff_size + 1);
-	if(cfg->buff == NULL)
+	while(table[i].key != NULL)
 	{
-		set_sigmask(SIGMASK_RST);
-		return -1;
+		k_list *key = table[i].key;
+
+		if(table[i].hash == hash && key->name_len == len)
+		{
+			if(stack->flags & CONFIG_ICASE)
+			{
+				if(fold_ncmp(key->name, name, len) == 0)
+					break;
+			}
+			else if(memcmp(key->name, name, len) == 0)
+				break;
+		}
+
+		i = (i + 1) & mask;
 	}
-	cfg->buff_pos = 0;
-	cfg->buff[cfg->buff_size] = '\0';
 
-	int reading = 1;
-	ssize_t state;
+	return &table[i];
+}
+
+static void stack_table_free(CONFIG_STACK *restrict stack)
+{
+	if(stack->table != NULL)
+		mem_free(&stack->alloc, stack->table, ((stack->table_mask + 1) * sizeof(struct stack_slot)));
+
+	stack->table = NULL;
+	stack->table_mask = 0;
+}
 
-	while(reading)
+// Builds the table, starting from the top layer, so the first
+// key we see for any name is the one that wins.
+// Within a layer, the first key of a name wins, just as it
+// would for config_search().
+static int stack_build(CONFIG_STACK *restrict stack)
+{
+	size_t count = 0;
+
+	for(size_t i = 0; i < stack->layer_count; i++)
 	{
-		errno = 0;
+		if(image_nodes(stack->layers[i].cfg) == -1)
+			return -1;
 
-		state = read(cfg->fd, cfg->buff, cfg->buff_size);
-		if(state == -1)
-			goto fail;
-		else if(state == 0)
-		{
-			if(errno != EAGAIN || errno != EINTR)
-				reading = 0;
-		}
-		else
-			cfg->buff_pos=0;
-		
-		for(int i=0;i < state;i++)
-		{
-			if(cfg->buff[i] == '\0')
-				cfg->buff[i] = ' ';
-		}
+		for(k_list *current = stack->layers[i].cfg->key_list; current != NULL; current = current->key_next)
+			count++;
+	}
 
-		cfg->buff[state] = '\0';
+	// Keeping the table at most half full keeps the probes
+	// short.
+	size_t size = 8;
+	while(size < count * 2)
+		size *= 2;
 
-		
-		if(cfg->key_list == NULL)
+	struct stack_slot *table = mem_zalloc(&stack->alloc, (size * sizeof(struct stack_slot)));
+	if(table == NULL)
+		return -1;
+
+	for(size_t i = stack->layer_count; i-- > 0;)
+	{
+		for(k_list *current = stack->layers[i].cfg->key_list; current != NULL; current = current->key_next)
 		{
-			state = list_add(&cfg->key_list);
-			if(cfg->key_list == NULL)
-				goto fail;	
-			cfg->key_current = &cfg->key_list;
+			uint32_t hash = stack_hash(stack, current->name, current->name_len);
+			struct stack_slot *slot = stack_slot(stack, table, (size - 1), current->name, current->name_len, hash);
+
+			if(slot->key == NULL)
+			{
+				slot->key = current;
+				slot->hash = hash;
+			}
 		}
-		
-		state = 0;
 
-		while(reading)
-		{
-			state = get_next_key(*cfg->key_current, cfg->buff, &cfg->buff_pos);
-			if(state == -1)
-				goto fail;
+		stack->layers[i].generation = stack->layers[i].cfg->generation;
+	}
 
-			// We break here if it's time to exit 
-			// to avoid adding an extra list entry
-			// (though that can still happen...)
-			// or closing everything in an if().
-			//
-			// Just feels a bit cleaner, for now.
-			// 			-Luna
-			if(state > 0 || state == -2)
-				break;
-			
-			if(list_add(cfg->key_current) == -1)
-				goto fail;
+	stack_table_free(stack);
+	stack->table = table;
+	stack->table_mask = size - 1;
 
-			cfg->key_current = &(*cfg->key_current)->key_next;
-		}
-	}
-	
-	// Due to a quirk of get_next_key(), we may have 
-	// accidentally allocated an empty key at the end of our
-	// list.
-	//
-	// I'f that's the case, we need to free it, or it may
-	// cause problems.
-	//
-	// There's probably a better solution to this, but this
-	// is fine for now.	
-	// 			-Luna
-	if((*cfg->key_current)->name == NULL)
-		list_free(cfg->key_current);
+	return 0;
+}
 
-	cfg->key_current = &cfg->key_list;
+// Finds the topmost key named 'name'.
+// Returns NULL with errno set to 0 if there isn't one.
+static k_list *stack_find(CONFIG_STACK *restrict stack, const char *restrict name, size_t len)
+{
+	int stale = (stack->table == NULL);
 
-	while(*cfg->key_current != NULL)
+	for(size_t i = 0; i < stack->layer_count && !stale; i++)
 	{
-		state = key_parse(*cfg->key_current);
-		if(state == -1)
-			goto fail;
-		
-		cfg->key_current = &(*cfg->key_current)->key_next;
+		if(stack->layers[i].generation != stack->layers[i].cfg->generation)
+			stale = 1;
 	}
 
-	cfg->key_current = &cfg->key_list;
+	if(stale && stack_build(stack) == -1)
+		return NULL;
 
-	set_sigmask(SIGMASK_RST);
-	return 0;
+	uint32_t hash = stack_hash(stack, name, len);
+	struct stack_slot *slot = stack_slot(stack, stack->table, stack->table_mask, name, len, hash);
 
-	fail:
+	if(slot->key == NULL)
+		errno = 0;
+
+	return key_load(slot->key);
+}
+
+CONFIG_STACK *config_stack_create(int flags)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	CONFIG_STACK *init = mem_alloc(&default_allocator, sizeof(CONFIG_STACK));
+	if(init == NULL)
+	{
 		set_sigmask(SIGMASK_RST);
-		list_free(&cfg->key_list);
-		free(cfg->buff);
-		return -1;
+		return NULL;
+	}
 
+	init->flags = flags;
+	init->layers = NULL;
+	init->layer_count = 0;
+	init->layer_size = 0;
+	init->table = NULL;
+	init->table_mask = 0;
+	init->alloc = default_allocator;
+
+	set_sigmask(SIGMASK_RST);
+	return init;
 }
 
-int config_rewind(CONFIG *restrict cfg)
+int config_stack_close(CONFIG_STACK *restrict stack)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return 0;
 
-	if(cfg == NULL || cfg->key_list == NULL)
-	{  
+	if(stack == NULL)
+	{
 		errno = EINVAL;
 
 		set_sigmask(SIGMASK_RST);
 		return 0;
 	}
 
-	cfg->key_current = &cfg->key_list;
+	struct config_allocator alloc = stack->alloc;
+
+	mem_free(&alloc, stack->layers, (stack->layer_size * sizeof(struct stack_layer)));
+	stack_table_free(stack);
+	mem_free(&alloc, stack, sizeof(CONFIG_STACK));
 
 	set_sigmask(SIGMASK_RST);
 	return 1;
 }
 
-int config_close(CONFIG *restrict cfg)
+// Adds 'cfg' to the top of the stack.
+int config_layer_push(CONFIG_STACK *restrict stack, CONFIG *restrict cfg)
 {
 	if(!set_sigmask(SIGMASK_SET))
-		return 0;
+		return -1;
 
-	if(cfg == NULL)
+	if(stack == NULL || cfg == NULL)
 	{
 		errno = EINVAL;
-
 		set_sigmask(SIGMASK_RST);
-		return 0;
+		return -1;
 	}
-	
-	// Should this be "free and close", or "close and free"?
-	// Either way, if close() fails, we're left in an 
-	// undefined state.
-	// 			-Luna
-	if(close(cfg->fd) != 0)
+
+	if(stack->layer_count == stack->layer_size)
 	{
-		set_sigmask(SIGMASK_RST);
-		return 0;
+		size_t size = (stack->layer_size > 0) ? stack->layer_size * 2 : 4;
+		struct stack_layer *tmp = mem_resize(&stack->alloc, stack->layers, (stack->layer_size * sizeof(struct stack_layer)), (size * sizeof(struct stack_layer)));
+		if(tmp == NULL)
+		{
+			set_sigmask(SIGMASK_RST);
+			return -1;
+		}
+
+		stack->layers = tmp;
+		stack->layer_size = size;
 	}
-	list_free(&cfg->key_list);
-	free(cfg->buff);
-	free(cfg);
+
+	stack->layers[stack->layer_count].cfg = cfg;
+	stack->layers[stack->layer_count].generation = cfg->generation;
+	stack->layer_count++;
+
+	stack_table_free(stack);
 
 	set_sigmask(SIGMASK_RST);
-	return 1;
+	return 0;
 }
 
-// I now remember why these functions return -1 on error. By 
-// returning -1 for error, 0 for the end of list, 1 for 
-// sucess, and greater than 1 to indicate a truncated data
-// buffer, we can quickly get some idea what's happening.
-//
-// Looking back over it more closely, that's actually pretty
-// obvious.
-// 			-Luna
-int config_index(CONFIG *restrict cfg, char *restrict name, char *restrict data_buff, unsigned int buff_size, unsigned int index)
+// Removes the top layer from the stack, and hands it back.
+CONFIG *config_layer_pop(CONFIG_STACK *restrict stack)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return NULL;
+
+	if(stack == NULL || stack->layer_count == 0)
+	{
+		errno = EINVAL;
+		set_sigmask(SIGMASK_RST);
+		return NULL;
+	}
+
+	stack->layer_count--;
+
+	stack_table_free(stack);
+
+	set_sigmask(SIGMASK_RST);
+	return stack->layers[stack->layer_count].cfg;
+}
+
+int config_stack_search(CONFIG_STACK *restrict stack, const char *restrict name, char *restrict data_buff, unsigned int buff_size)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return -1;
 
-	if(name == NULL || data_buff == NULL)
+	if(stack == NULL || name == NULL)
 	{
+		if(data_buff != NULL)
+			data_buff[0] = '\0';
+
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
 
-	if(cfg == NULL || cfg->key_list == NULL)
+	k_list *key = stack_find(stack, name, strlen(name));
+
+	if(key == NULL)
 	{
-		name[0] = '\0';
-		data_buff[0] = '\0';
+		if(data_buff != NULL)
+			data_buff[0] = '\0';
 
-		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
-		return -1;
+		return (errno == 0) ? 0 : -1;
 	}
 
-	k_list *tmp;
+	int state = 1;
 
-	tmp = list_get(index, cfg->key_list);
-	if(tmp == NULL)
+	if(data_buff != NULL)
+		state = copy_value(data_buff, buff_size, key);
+
+	set_sigmask(SIGMASK_RST);
+	return state;
+}
+
+int config_stack_search_br(CONFIG_STACK *restrict stack, const char *restrict name, char **restrict data)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return -1;
+
+	if(stack == NULL || name == NULL)
 	{
-		name[0] = '\0';
-		data_buff[0] = '\0';
+		if(data != NULL)
+			*data = NULL;
 
+		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
-		return 0;
+		return -1;
 	}
-	else
-	{
-		if(strlen(tmp->name) > (CONFIG_MAX_KEY - 1))
-		{
-			memcpy(name, tmp->name, (CONFIG_MAX_KEY));
-			name[CONFIG_MAX_KEY - 1] = '\0';
-		}
-		else
-			memcpy(name, tmp->name, (strlen(tmp->name) + 1));
 
-		if(strlen(tmp->value) > (buff_size - 1))
-		{
-			memcpy(data_buff, tmp->value, (buff_size));
-			data_buff[buff_size - 1] = '\0';
+	k_list *key = stack_find(stack, name, strlen(name));
 
-			set_sigmask(SIGMASK_RST);
-			return(strlen(tmp->value) - buff_size);
-		}
-		else
-			memcpy(data_buff, tmp->value, (strlen(tmp->value) + 1));
-	}
+	if(data != NULL)
+		*data = (key != NULL) ? key->value : NULL;
 
 	set_sigmask(SIGMASK_RST);
+
+	if(key == NULL)
+		return (errno == 0) ? 0 : -1;
+
 	return 1;
 }
 
-int config_search(CONFIG *restrict cfg, const char *restrict name, char *restrict data_buff, unsigned int buff_size)
+int config_stack_search_sv(CONFIG_STACK *restrict stack, config_sv name, config_sv *restrict data)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return -1;
 
-	if(cfg == NULL || cfg->key_current == NULL || name == NULL)
+	if(stack == NULL || name.ptr == NULL)
 	{
-		if(data_buff != NULL)
-			data_buff[0] = '\0';
+		if(data != NULL)
+			*data = (config_sv){NULL, 0};
 
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
 
-	while(1)
-	{
-		if(*cfg->key_current == NULL || fast_cmp((*cfg->key_current)->name, name))
-			break;
+	k_list *key = stack_find(stack, name.ptr, name.len);
 
-		cfg->key_current = &(*cfg->key_current)->key_next;
+	if(data != NULL)
+	{
+		if(key != NULL)
+			*data = (config_sv){key->value, key->value_len};
+		else
+			*data = (config_sv){NULL, 0};
 	}
 
-	if(*(cfg->key_current) == NULL)
-	{
-		if(data_buff != NULL)
-			data_buff[0] = '\0';
+	set_sigmask(SIGMASK_RST);
 
-		set_sigmask(SIGMASK_RST);
-		return 0;
-	}
-	else
+	if(key == NULL)
+		return (errno == 0) ? 0 : -1;
+
+	return 1;
+}
+
+/*
+ * Here we start on sharing a parsed configuration between
+ * processes.
+ *
+ * A pre-forking server can parse its configuration once in the
+ * master, and publish it as an image in shared memory. Workers
+ * attach to the image read-only, so however many workers there
+ * are, there's only one copy of the keys.
+ *
+ * The master and workers find the current image through a
+ * small control block, made before forking, which is guarded
+ * by a sequence count.
+ */
+
+#define SHARE_MAGIC 0x6c72636eu
+
+#ifndef NO_SHM
+struct share_ctl
+{
+	atomic_uint     seq;
+	atomic_ulong    generation;
+	size_t          size;
+	char            name[48];
+};
+#endif
+
+struct config_share
+{
+	#ifndef NO_SHM
+	struct share_ctl *ctl;
+	#endif
+	pid_t             owner;
+	struct config_allocator alloc;
+};
+
+#ifndef NO_SHM
+// Copies the keylist of 'cfg' into the image at 'head', which
+// is 'size' bytes.
+static void image_write(struct share_image *restrict head, CONFIG *restrict cfg, size_t count, size_t size)
+{
+	struct share_key *keys = (struct share_key *)((char *)head + image_align(sizeof(struct share_image)));
+	size_t offset = (size_t)((char *)(keys + count) - (char *)head);
+	size_t i = 0;
+
+	head->magic = SHARE_MAGIC;
+	head->flags = cfg->flags & ~CONFIG_LAZY;
+	head->size = size;
+	head->count = count;
+	head->tag_value[0] = '\n';
+	head->tag_value[1] = '\0';
+
+	for(k_list *current = cfg->key_list; current != NULL; current = current->key_next, i++)
 	{
-		if(data_buff != NULL && strlen((*cfg->key_current)->value) > (buff_size - 1))
-		{
-			memcpy(data_buff, (*cfg->key_current)->value, (buff_size));
-			data_buff[buff_size - 1] = '\0';
-			cfg->key_current = &(*cfg->key_current)->key_next;
+		struct share_key *key = &keys[i];
 
-			set_sigmask(SIGMASK_RST);
-			return(strlen((*cfg->key_current)->value) - buff_size);
+		key_load(current);
+
+		key->name = offset;
+		key->name_len = current->name_len;
+		memcpy((char *)head + offset, current->name, (current->name_len + 1));
+		offset += current->name_len + 1;
+
+		// Tags all share the value in the header.
+		if(current->value_len == 1 && current->value[0] == '\n')
+			key->value = offsetof(struct share_image, tag_value);
+		else
+		{
+			key->value = offset;
+			memcpy((char *)head + offset, current->value, (current->value_len + 1));
+			offset += current->value_len + 1;
 		}
-		else if(data_buff != NULL)
-			memcpy(data_buff, (*cfg->key_current)->value, (strlen((*cfg->key_current)->value) + 1));
 
-		cfg->key_current = &(*cfg->key_current)->key_next;
+		key->value_len = current->value_len;
+		key->name_hash = current->name_hash;
+	}
+}
 
-		set_sigmask(SIGMASK_RST);
-		return 1;
+// Maps the image named 'name' read-only, wherever it fits.
+static struct share_image *image_map(const char *restrict name, size_t size)
+{
+	int fd = shm_open(name, O_RDONLY, 0);
+	if(fd < 0)
+		return NULL;
+
+	void *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+
+	int err = errno;
+	close(fd);
+	errno = err;
+
+	if(map == MAP_FAILED)
+		return NULL;
+
+	struct share_image *head = map;
+
+	if(size < sizeof(struct share_image) || head->magic != SHARE_MAGIC || head->size != size)
+	{
+		munmap(map, size);
+		errno = EINVAL;
+		return NULL;
 	}
+
+	return head;
 }
+#endif
 
-int config_next(CONFIG *restrict cfg, char *restrict name, char *restrict data_buff, unsigned int buff_size)
+// Creates the control block that a master and its workers use
+// to find the current image.
+// This must be done before forking.
+CONFIG_SHARE *config_share_create(void)
 {
 	if(!set_sigmask(SIGMASK_SET))
-		return -1;
+		return NULL;
 
-	if(name == NULL || data_buff == NULL)
+	#ifdef NO_SHM
+	errno = ENOSYS;
+	set_sigmask(SIGMASK_RST);
+	return NULL;
+	#else
+	CONFIG_SHARE *init = mem_alloc(&default_allocator, sizeof(CONFIG_SHARE));
+	if(init == NULL)
 	{
-		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
-		return -1;
+		return NULL;
 	}
 
-	if(cfg == NULL || cfg->key_current == NULL)
+	init->ctl = mmap(NULL, sizeof(struct share_ctl), (PROT_READ | PROT_WRITE), (MAP_SHARED | MAP_ANONYMOUS), -1, 0);
+	if(init->ctl == MAP_FAILED)
 	{
-		name[0] = '\0';
-		data_buff[0] = '\0';
-
-		errno = EINVAL;
+		mem_free(&default_allocator, init, sizeof(CONFIG_SHARE));
 		set_sigmask(SIGMASK_RST);
-		return -1;
+		return NULL;
 	}
 
-	if(*cfg->key_current == NULL)
+	atomic_init(&init->ctl->seq, 0);
+	atomic_init(&init->ctl->generation, 0);
+	init->ctl->size = 0;
+	init->ctl->name[0] = '\0';
+	init->owner = getpid();
+	init->alloc = default_allocator;
+
+	set_sigmask(SIGMASK_RST);
+	return init;
+	#endif
+}
+
+// Closes the control block.
+// If this is the process that made it, the current image is
+// removed too, although anyone still attached to it may keep
+// using it.
+int config_share_close(CONFIG_SHARE *restrict share)
+{
+	if(!set_sigmask(SIGMASK_SET))
+		return 0;
+
+	if(share == NULL)
 	{
-		name[0] = '\0';
-		data_buff[0] = '\0';
+		errno = EINVAL;
 
 		set_sigmask(SIGMASK_RST);
 		return 0;
 	}
-	else
-	{
-		if(strlen((*cfg->key_current)->name) > (CONFIG_MAX_KEY - 1))
-		{
-			memcpy(name, (*cfg->key_current)->name, (CONFIG_MAX_KEY));
-			name[CONFIG_MAX_KEY - 1] = '\0';
-		}
-		else
-			memcpy(name, (*cfg->key_current)->name, (strlen((*cfg->key_current)->name) + 1));
-
-		if(strlen((*cfg->key_current)->value) > (buff_size - 1))
-		{
-			memcpy(data_buff, (*cfg->key_current)->value, (buff_size));
-			data_buff[buff_size - 1] = '\0';
-			cfg->key_current = &(*cfg->key_current)->key_next;
 
-			set_sigmask(SIGMASK_RST);
-			return(strlen((*cfg->key_current)->value) - buff_size);
-		}
-		else
-			memcpy(data_buff, (*cfg->key_current)->value, (strlen((*cfg->key_current)->value) + 1));
-	}
+	#ifndef NO_SHM
+	if(share->owner == getpid() && share->ctl->name[0] != '\0')
+		shm_unlink(share->ctl->name);
 
-	cfg->key_current = &(*cfg->key_current)->key_next;
+	munmap(share->ctl, sizeof(struct share_ctl));
+	#endif
+	mem_free(&share->alloc, share, sizeof(CONFIG_SHARE));
 
 	set_sigmask(SIGMASK_RST);
 	return 1;
 }
 
-// The by-reference function were originaly a debug tool, but
-// ended up being useful, so I left them in as a feature.
-// 			-Luna
-int config_index_br(CONFIG *restrict cfg, char **restrict name, char **restrict data, unsigned int index)
+// Publishes the keylist of 'cfg' as the next generation.
+// Only the process that made 'share' may publish to it.
+int config_share_publish(CONFIG_SHARE *restrict share, CONFIG *restrict cfg)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return -1;
 
-	if(name == NULL || data == NULL)
+	#ifdef NO_SHM
+	(void)share;
+	(void)cfg;
+	errno = ENOSYS;
+	set_sigmask(SIGMASK_RST);
+	return -1;
+	#else
+	if(share == NULL || cfg == NULL || cfg->reading || share->owner != getpid())
 	{
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
 
-	if(cfg == NULL || cfg->key_list == NULL)
+	// An attached CONFIG can be published again, once it has a
+	// keylist to pack.
+	if(image_nodes(cfg) == -1)
 	{
-		*name = NULL;
-		*data = NULL;
-
-		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
 
-	k_list *tmp;
+	struct share_ctl *ctl = share->ctl;
+	unsigned long generation = atomic_load(&ctl->generation) + 1;
+	size_t count;
+	size_t size = pack_size(cfg, &count);
 
-	tmp = list_get(index, cfg->key_list);
-	if(tmp == NULL)
-	{
-		*name = NULL;
-		*data = NULL;
+	size += image_align(sizeof(struct share_image)) + (count * sizeof(struct share_key));
 
-		set_sigmask(SIGMASK_RST);
-		return 0;
-	}
-	else
-	{
-		*name = tmp->name;
-		*data = tmp->value;
+	char name[sizeof(ctl->name)];
+	snprintf(name, sizeof(name), "/libreadconf.%ld.%lu", (long)share->owner, generation);
+
+	int fd = shm_open(name, (O_RDWR | O_CREAT | O_EXCL), 0600);
+	if(fd < 0)
+		goto fail;
+
+	if(ftruncate(fd, size) != 0)
+		goto fail_unlink;
+
+	struct share_image *head = mmap(NULL, size, (PROT_READ | PROT_WRITE), MAP_SHARED, fd, 0);
+	if(head == MAP_FAILED)
+		goto fail_unlink;
+
+	image_write(head, cfg, count, size);
+	head->generation = generation;
+
+	munmap(head, size);
+	close(fd);
+
+	char old[sizeof(ctl->name)];
+	memcpy(old, ctl->name, sizeof(old));
+
+	// Writers make the count odd while they change anything,
+	// so readers know to try again.
+	atomic_fetch_add_explicit(&ctl->seq, 1, memory_order_acq_rel);
+	ctl->size = size;
+	memcpy(ctl->name, name, sizeof(name));
+	atomic_store_explicit(&ctl->generation, generation, memory_order_relaxed);
+	atomic_fetch_add_explicit(&ctl->seq, 1, memory_order_release);
+
+	// Workers that already have the old image mapped keep it
+	// until they let go of it.
+	if(old[0] != '\0')
+		shm_unlink(old);
+
+	set_sigmask(SIGMASK_RST);
+	return 0;
 
+	fail_unlink:
+		{
+			int err = errno;
+			close(fd);
+			shm_unlink(name);
+			errno = err;
+		}
+	fail:
 		set_sigmask(SIGMASK_RST);
-		return 1;
-	}
+		return -1;
+	#endif
 }
 
-int config_search_br(CONFIG *restrict cfg, const char *restrict name, char **restrict data)
+// Attaches to the current image, returning a read-only CONFIG
+// that can be used with any of the search functions.
+CONFIG *config_share_attach(CONFIG_SHARE *restrict share)
 {
 	if(!set_sigmask(SIGMASK_SET))
-		return -1;
+		return NULL;
 
-	if(cfg == NULL || cfg->key_current == NULL || *cfg->key_current == NULL || name == NULL)
+	#ifdef NO_SHM
+	(void)share;
+	errno = ENOSYS;
+	set_sigmask(SIGMASK_RST);
+	return NULL;
+	#else
+	if(share == NULL)
 	{
-		if(data != NULL)
-			*data = NULL;
-
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
-		return -1;
+		return NULL;
 	}
-	
-	while(1)
+
+	struct share_ctl *ctl = share->ctl;
+	struct share_image *head = NULL;
+
+	// If the master publishes while we're looking, the image
+	// we were told about may already be gone, so we just try
+	// again.
+	while(head == NULL)
 	{
-		if(*cfg->key_current == NULL || fast_cmp((*cfg->key_current)->name, name))
-			break;
+		char name[sizeof(ctl->name)];
+		size_t size;
+		unsigned int seq = atomic_load_explicit(&ctl->seq, memory_order_acquire);
 
-		cfg->key_current = &(*cfg->key_current)->key_next;
+		if(seq & 1)
+			continue;
+
+		size = ctl->size;
+		memcpy(name, ctl->name, sizeof(name));
+
+		atomic_thread_fence(memory_order_acquire);
+		if(atomic_load_explicit(&ctl->seq, memory_order_relaxed) != seq)
+			continue;
+
+		if(name[0] == '\0')
+		{
+			errno = ENOENT;
+			set_sigmask(SIGMASK_RST);
+			return NULL;
+		}
+
+		head = image_map(name, size);
+		if(head == NULL && errno != ENOENT)
+		{
+			set_sigmask(SIGMASK_RST);
+			return NULL;
+		}
 	}
 
-	if(*cfg->key_current == NULL)
+	CONFIG *init = mem_alloc(&default_allocator, sizeof(CONFIG));
+	if(init == NULL)
 	{
-		if(data != NULL)
-			*data = NULL;
-
+		munmap(head, head->size);
 		set_sigmask(SIGMASK_RST);
-		return 0;
+		return NULL;
 	}
-	else
-	{
-		if(data != NULL)
-			*data = (*cfg->key_current)->value;
-		cfg->key_current = &(*cfg->key_current)->key_next;
 
+	if(config_init(init, -1, head->flags) == -1)
+	{
+		munmap(head, head->size);
+		mem_free(&default_allocator, init, sizeof(CONFIG));
 		set_sigmask(SIGMASK_RST);
-		return 1;
+		return NULL;
 	}
+
+	// Nothing is copied out of the image; the keys are read
+	// from it where they are.
+	init->image = head;
+	key_rewind(init);
+
+	set_sigmask(SIGMASK_RST);
+	return init;
+	#endif
 }
 
-int config_next_br(CONFIG *restrict cfg, char **restrict name, char **restrict data)
+// Returns 1 if a newer image than the one 'cfg' is attached
+// to has been published, so workers can check cheaply before
+// attaching again.
+int config_share_changed(CONFIG_SHARE *restrict share, CONFIG *restrict cfg)
 {
 	if(!set_sigmask(SIGMASK_SET))
 		return -1;
 
-	if(name == NULL || data == NULL)
-	{
-		errno = EINVAL;
-		set_sigmask(SIGMASK_RST);
-		return -1;
-	}
-
-	if(cfg == NULL || cfg->key_list == NULL)
+	if(share == NULL || cfg == NULL || cfg->image == NULL)
 	{
-		*name = NULL;
-		*data = NULL;
-
 		errno = EINVAL;
 		set_sigmask(SIGMASK_RST);
 		return -1;
 	}
 
-	if(*cfg->key_current == NULL)
-	{
-		*name = NULL;
-		*data = NULL;
-
-		set_sigmask(SIGMASK_RST);
-		return 0;
-	}
-	else
-	{
-		*name = (*cfg->key_current)->name;
-		*data = (*cfg->key_current)->value;
-		cfg->key_current = &(*cfg->key_current)->key_next;
+	#ifdef NO_SHM
+	set_sigmask(SIGMASK_RST);
+	return 0;
+	#else
+	int changed = atomic_load_explicit(&share->ctl->generation, memory_order_acquire) != cfg->image->generation;
 
-		set_sigmask(SIGMASK_RST);
-		return 1;
-	}
+	set_sigmask(SIGMASK_RST);
+	return changed;
+	#endif
 }
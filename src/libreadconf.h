@@ -17,21 +17,125 @@
 #ifndef LIBREADCONF_H
 #define LIBREADCONF_H
 
+#include <stddef.h>
+
 // Used to determine the options supported by the current version.
-#define _LIBREADCONF_VSPEC_ 10000
+#define _LIBREADCONF_VSPEC_ 12100
 
 #define CONFIG_MAX_KEY 64
 
+// Flags for config_open_flags() and config_fdopen_flags().
+#define CONFIG_ICASE 0x01
+#define CONFIG_LAZY  0x02
+#define CONFIG_APPEND 0x04
+
+// Field types for config_bind().
+#define CONFIG_TYPE_STRING 1
+#define CONFIG_TYPE_BUFF   2
+#define CONFIG_TYPE_SV     3
+#define CONFIG_TYPE_INT    4
+#define CONFIG_TYPE_UINT   5
+#define CONFIG_TYPE_LONG   6
+#define CONFIG_TYPE_ULONG  7
+#define CONFIG_TYPE_DOUBLE 8
+#define CONFIG_TYPE_BOOL   9
+
+// Field flags for config_bind().
+#define CONFIG_FIELD_REQUIRED 0x01
+
+// Problems passed to a config_bind_report() callback.
+#define CONFIG_BIND_UNKNOWN 1
+#define CONFIG_BIND_MISSING 2
+#define CONFIG_BIND_INVALID 3
+
+// Changes passed to a config_subscribe() callback.
+#define CONFIG_CHANGE_ADDED    1
+#define CONFIG_CHANGE_REMOVED  2
+#define CONFIG_CHANGE_MODIFIED 3
+
 #ifdef __cplusplus
 extern "C"{
 #endif
 
 typedef struct config CONFIG;
+typedef struct config_stack CONFIG_STACK;
+typedef struct config_share CONFIG_SHARE;
+typedef struct config_pool CONFIG_POOL;
+
+// A string-view, as used by the "_sv" functions.
+// 'ptr' is still terminated, but 'len' saves a strlen().
+// This holds for values found by the lookup functions too,
+// including lazily read ones.
+typedef struct config_sv
+{
+	const char *ptr;
+	size_t      len;
+} config_sv;
+
+typedef int (*config_iter_fn)(const char *name, const char *data, void *arg);
+
+// Describes one member of a structure for config_bind().
+// 'size' is only used by CONFIG_TYPE_BUFF fields.
+struct config_field
+{
+	const char *name;
+	int         type;
+	size_t      offset;
+	size_t      size;
+	int         flags;
+};
+
+typedef void (*config_report_fn)(int problem, const char *name, const char *data, void *arg);
+typedef void (*config_change_fn)(int change, const char *name, const char *data, void *arg);
+
+// A key schema for config_map(), as written by the
+// libreadconf-schema tool.
+// 'slot' returns the slot of a name, or -1 for unknown names.
+struct config_schema
+{
+	size_t              count;
+	const char *const  *names;
+	int               (*slot)(const char *name, size_t len);
+};
+
+// Filled in by config_pool_stats().
+// 'bytes' is all the memory the pool uses, and 'saved' what it
+// saves over a copy of each string for every key using it.
+struct config_pool_stats
+{
+	size_t strings;
+	size_t refs;
+	size_t bytes;
+	size_t saved;
+};
+
+// Memory hooks for config_set_allocator().
+// 'resize' and 'release' are given the size of the block, as
+// passed to 'alloc', so they can be used for arenas and pools.
+struct config_allocator
+{
+	void *(*alloc)(size_t size, void *ctx);
+	void *(*resize)(void *ptr, size_t old_size, size_t new_size, void *ctx);
+	void  (*release)(void *ptr, size_t size, void *ctx);
+	void   *ctx;
+};
 
 extern CONFIG *config_open(const char *path);
 extern CONFIG *config_fdopen(int fd);
+extern CONFIG *config_open_flags(const char *path, int flags);
+extern CONFIG *config_fdopen_flags(int fd, int flags);
 extern CONFIG *config_reopen(const char * path, CONFIG *cfg);
+extern int config_open_many(const char *const paths[], size_t count, CONFIG *out[], int errs[], int flags);
+extern CONFIG *config_create(int flags);
+extern CONFIG *config_open_cached(const char *path);
+extern CONFIG *config_open_cached_flags(const char *path, int flags);
+extern int config_set_allocator(CONFIG *cfg, const struct config_allocator *alloc);
+extern int config_set_limits(CONFIG *cfg, size_t max_bytes, size_t max_entries, size_t max_line, size_t max_value);
 extern int config_read(CONFIG *cfg);
+extern int config_feed(CONFIG *cfg, const char *data, size_t len);
+extern int config_feed_end(CONFIG *cfg);
+extern CONFIG *config_load(const char *path, int flags);
+extern int config_finish(CONFIG *cfg);
 extern int config_close(CONFIG *cfg);
 extern int config_rewind(CONFIG *cfg);
 
@@ -42,6 +146,49 @@ extern int config_next(CONFIG *cfg, char *name, char *data_buff, unsigned int bu
 extern int config_index_br(CONFIG *cfg, char **name, char **data, unsigned int index);
 extern int config_search_br(CONFIG *cfg, const char *name, char **data);
 extern int config_next_br(CONFIG *cfg, char **name, char **data);
+
+extern int config_index_sv(CONFIG *cfg, config_sv *name, config_sv *data, unsigned int index);
+extern int config_search_sv(CONFIG *cfg, config_sv name, config_sv *data);
+extern int config_next_sv(CONFIG *cfg, config_sv *name, config_sv *data);
+
+extern int config_lookup(CONFIG *cfg, const char *name, char *data_buff, unsigned int buff_size);
+extern int config_lookup_sv(CONFIG *cfg, config_sv name, config_sv *data);
+
+extern int config_values(CONFIG *cfg, const char *name, const char ***values, size_t *count);
+
+extern int config_set(CONFIG *cfg, const char *name, const char *value);
+extern int config_unset(CONFIG *cfg, const char *name);
+
+extern int config_subscribe(CONFIG *cfg, const char *name, config_change_fn callback, void *arg);
+extern int config_unsubscribe(CONFIG *cfg, const char *name, config_change_fn callback, void *arg);
+
+extern int config_prefix_iter(CONFIG *cfg, const char *prefix, config_iter_fn callback, void *arg);
+extern int config_range_iter(CONFIG *cfg, const char *first, const char *last, config_iter_fn callback, void *arg);
+
+extern int config_bind(CONFIG *cfg, const struct config_field fields[], size_t count, void *out);
+extern int config_bind_report(CONFIG *cfg, const struct config_field fields[], size_t count, void *out, config_report_fn report, void *arg);
+
+extern int config_map(CONFIG *cfg, const struct config_schema *schema, config_sv slots[]);
+extern int config_map_report(CONFIG *cfg, const struct config_schema *schema, config_sv slots[], config_report_fn report, void *arg);
+
+extern CONFIG_STACK *config_stack_create(int flags);
+extern int config_stack_close(CONFIG_STACK *stack);
+extern int config_layer_push(CONFIG_STACK *stack, CONFIG *cfg);
+extern CONFIG *config_layer_pop(CONFIG_STACK *stack);
+extern int config_stack_search(CONFIG_STACK *stack, const char *name, char *data_buff, unsigned int buff_size);
+extern int config_stack_search_br(CONFIG_STACK *stack, const char *name, char **data);
+extern int config_stack_search_sv(CONFIG_STACK *stack, config_sv name, config_sv *data);
+
+extern CONFIG_POOL *config_pool_create(size_t max_value);
+extern int config_pool_close(CONFIG_POOL *pool);
+extern int config_set_pool(CONFIG *cfg, CONFIG_POOL *pool);
+extern int config_pool_stats(CONFIG_POOL *pool, struct config_pool_stats *stats);
+
+extern CONFIG_SHARE *config_share_create(void);
+extern int config_share_close(CONFIG_SHARE *share);
+extern int config_share_publish(CONFIG_SHARE *share, CONFIG *cfg);
+extern CONFIG *config_share_attach(CONFIG_SHARE *share);
+extern int config_share_changed(CONFIG_SHARE *share, CONFIG *cfg);
   
 #ifdef __cplusplus
 }
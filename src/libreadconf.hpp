@@ -0,0 +1,348 @@
+/*
+ * This file is part of libreadconf.
+ *
+ * libreadconf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * libreadconf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libreadconf.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LIBREADCONF_HPP
+#define LIBREADCONF_HPP
+
+// A header-only C++17 wrapper around libreadconf.
+//
+// Everything here is inline and forwards straight to the "_sv"
+// functions, so names and values are handed out as views of
+// the memory owned by the CONFIG, and nothing is copied.
+
+#include <cerrno>
+#include <charconv>
+#include <cstddef>
+#include <iterator>
+#include <optional>
+#include <string>
+#include <string_view>
+#include <system_error>
+#include <type_traits>
+
+#include "libreadconf.h"
+
+namespace libreadconf
+{
+
+// A single item from the keylist.
+// Items that aren't keys (tags) have a value of "\n".
+struct Entry
+{
+	std::string_view name;
+	std::string_view value;
+
+	bool is_tag() const noexcept
+	{
+		return value == "\n";
+	}
+};
+
+namespace detail
+{
+	inline std::string_view view(const config_sv &sv) noexcept
+	{
+		return std::string_view(sv.ptr, sv.len);
+	}
+
+	[[noreturn]] inline void throw_errno(const char *what)
+	{
+		throw std::system_error(errno, std::generic_category(), what);
+	}
+
+	// Compares a value to a lowercase word, folding only the
+	// ASCII letters, as config_bind() does.
+	inline bool fold_equal(std::string_view value, std::string_view word) noexcept
+	{
+		if(value.size() != word.size())
+			return false;
+
+		for(std::size_t i = 0; i < value.size(); i++)
+		{
+			char c = value[i];
+
+			if(c >= 'A' && c <= 'Z')
+				c += 'a' - 'A';
+			if(c != word[i])
+				return false;
+		}
+
+		return true;
+	}
+
+	// Converts a value to T, or fails with an empty optional.
+	// Only the whole value is accepted, so "12abc" isn't 12.
+	template<typename T>
+	std::optional<T> parse(std::string_view value)
+	{
+		if constexpr(std::is_same_v<T, std::string_view>)
+			return value;
+		else if constexpr(std::is_same_v<T, std::string>)
+			return std::string(value);
+		else if constexpr(std::is_same_v<T, bool>)
+		{
+			if(fold_equal(value, "true") || fold_equal(value, "yes") || fold_equal(value, "on") || value == "1")
+				return true;
+			if(fold_equal(value, "false") || fold_equal(value, "no") || fold_equal(value, "off") || value == "0")
+				return false;
+			return std::nullopt;
+		}
+		else if constexpr(std::is_arithmetic_v<T>)
+		{
+			T out{};
+			const char *end = value.data() + value.size();
+			auto res = std::from_chars(value.data(), end, out);
+
+			if(res.ec != std::errc() || res.ptr != end)
+				return std::nullopt;
+			return out;
+		}
+		else
+			static_assert(std::is_arithmetic_v<T>, "libreadconf: unsupported type for get<T>()");
+	}
+}
+
+// Maps the type of a structure member to the config_bind()
+// field type used to fill it.
+template<typename T> struct field_type { static constexpr int value = 0; };
+template<> struct field_type<char *> { static constexpr int value = CONFIG_TYPE_STRING; };
+template<> struct field_type<const char *> { static constexpr int value = CONFIG_TYPE_STRING; };
+template<std::size_t N> struct field_type<char[N]> { static constexpr int value = CONFIG_TYPE_BUFF; };
+template<> struct field_type<config_sv> { static constexpr int value = CONFIG_TYPE_SV; };
+template<> struct field_type<int> { static constexpr int value = CONFIG_TYPE_INT; };
+template<> struct field_type<unsigned int> { static constexpr int value = CONFIG_TYPE_UINT; };
+template<> struct field_type<long> { static constexpr int value = CONFIG_TYPE_LONG; };
+template<> struct field_type<unsigned long> { static constexpr int value = CONFIG_TYPE_ULONG; };
+template<> struct field_type<double> { static constexpr int value = CONFIG_TYPE_DOUBLE; };
+template<> struct field_type<bool> { static constexpr int value = CONFIG_TYPE_BOOL; };
+
+// Builds a config_field for a member of type M at compile time.
+// Use the LIBREADCONF_FIELD() macros rather than calling this
+// directly.
+template<typename M>
+constexpr config_field make_field(const char *name, std::size_t offset, int flags = 0)
+{
+	static_assert(field_type<M>::value != 0, "libreadconf: unsupported member type for config_bind()");
+	return config_field{name, field_type<M>::value, offset, sizeof(M), flags};
+}
+
+// LIBREADCONF_FIELD(Settings, port) describes 'Settings::port',
+// bound to the key "port". The _AS form binds it to another
+// key name, and takes config_bind() field flags.
+#define LIBREADCONF_FIELD(TYPE, MEMBER) \
+	::libreadconf::make_field<decltype(TYPE::MEMBER)>(#MEMBER, offsetof(TYPE, MEMBER))
+#define LIBREADCONF_FIELD_AS(TYPE, MEMBER, NAME, FLAGS) \
+	::libreadconf::make_field<decltype(TYPE::MEMBER)>(NAME, offsetof(TYPE, MEMBER), FLAGS)
+
+// A move-only owner of a CONFIG.
+//
+// Iterating a Config, find(), and find_next() all use the
+// keylist position of the underlying CONFIG, just like the
+// C functions they wrap. Only one loop should walk a Config
+// at a time.
+class Config
+{
+	public:
+		class iterator
+		{
+			public:
+				using iterator_category = std::input_iterator_tag;
+				using value_type = Entry;
+				using difference_type = std::ptrdiff_t;
+				using pointer = const Entry *;
+				using reference = const Entry &;
+
+				iterator() noexcept = default;
+
+				explicit iterator(CONFIG *cfg) noexcept : cfg_(cfg)
+				{
+					++*this;
+				}
+
+				reference operator*() const noexcept { return entry_; }
+				pointer operator->() const noexcept { return &entry_; }
+
+				iterator &operator++() noexcept
+				{
+					config_sv name, value;
+
+					if(config_next_sv(cfg_, &name, &value) == 1)
+						entry_ = Entry{detail::view(name), detail::view(value)};
+					else
+						cfg_ = nullptr;
+
+					return *this;
+				}
+
+				void operator++(int) noexcept { ++*this; }
+
+				bool operator==(const iterator &other) const noexcept { return cfg_ == other.cfg_; }
+				bool operator!=(const iterator &other) const noexcept { return cfg_ != other.cfg_; }
+
+			private:
+				CONFIG *cfg_ = nullptr;
+				Entry entry_;
+		};
+
+		Config() noexcept = default;
+
+		// Takes ownership of an already open CONFIG.
+		explicit Config(CONFIG *cfg) noexcept : cfg_(cfg) {}
+
+		// Opens and reads 'path', throwing std::system_error
+		// on failure.
+		explicit Config(const char *path, int flags = 0)
+		{
+			cfg_ = config_open_flags(path, flags);
+			if(cfg_ == nullptr)
+				detail::throw_errno("config_open");
+
+			if(config_read(cfg_) == -1)
+			{
+				int err = errno;
+				config_close(cfg_);
+				cfg_ = nullptr;
+				errno = err;
+				detail::throw_errno("config_read");
+			}
+		}
+
+		explicit Config(const std::string &path, int flags = 0) : Config(path.c_str(), flags) {}
+
+		Config(const Config &) = delete;
+		Config &operator=(const Config &) = delete;
+
+		Config(Config &&other) noexcept : cfg_(other.cfg_)
+		{
+			other.cfg_ = nullptr;
+		}
+
+		Config &operator=(Config &&other) noexcept
+		{
+			if(this != &other)
+			{
+				reset();
+				cfg_ = other.cfg_;
+				other.cfg_ = nullptr;
+			}
+			return *this;
+		}
+
+		~Config()
+		{
+			reset();
+		}
+
+		void reset(CONFIG *cfg = nullptr) noexcept
+		{
+			if(cfg_ != nullptr)
+				config_close(cfg_);
+			cfg_ = cfg;
+		}
+
+		CONFIG *release() noexcept
+		{
+			CONFIG *cfg = cfg_;
+			cfg_ = nullptr;
+			return cfg;
+		}
+
+		CONFIG *get() const noexcept { return cfg_; }
+		explicit operator bool() const noexcept { return cfg_ != nullptr; }
+
+		// Starting a loop rewinds the keylist.
+		iterator begin() noexcept
+		{
+			config_rewind(cfg_);
+			return iterator(cfg_);
+		}
+
+		iterator end() noexcept
+		{
+			return iterator();
+		}
+
+		// Finds the first value of 'name'.
+		std::optional<std::string_view> find(std::string_view name) noexcept
+		{
+			config_rewind(cfg_);
+			return find_next(name);
+		}
+
+		// Finds the next value of 'name' after the current
+		// keylist position.
+		std::optional<std::string_view> find_next(std::string_view name) noexcept
+		{
+			config_sv value;
+
+			if(config_search_sv(cfg_, config_sv{name.data(), name.size()}, &value) != 1)
+				return std::nullopt;
+			return detail::view(value);
+		}
+
+		// Finds the first value of 'name' and converts it to T.
+		// Returns an empty optional if the key is missing, or
+		// if the value can't be converted.
+		template<typename T>
+		std::optional<T> get(std::string_view name)
+		{
+			std::optional<std::string_view> value = find(name);
+
+			if(!value)
+				return std::nullopt;
+			return detail::parse<T>(*value);
+		}
+
+		template<typename T>
+		T get(std::string_view name, T fallback)
+		{
+			return get<T>(name).value_or(fallback);
+		}
+
+		// Fills 'out' from the keylist in a single pass.
+		// 'fields' is usually a static constexpr table built
+		// with LIBREADCONF_FIELD(). Returns the number of fields
+		// set, or -1 if a required field was missing.
+		template<typename S, std::size_t N>
+		int bind(S &out, const config_field (&fields)[N]) noexcept
+		{
+			static_assert(std::is_standard_layout_v<S>, "libreadconf: bound structures need a standard layout");
+			return config_bind(cfg_, fields, N, &out);
+		}
+
+		// The same, but calls report(problem, name, value) for
+		// every unknown, missing, or invalid key.
+		template<typename S, std::size_t N, typename F>
+		int bind(S &out, const config_field (&fields)[N], F &&report)
+		{
+			static_assert(std::is_standard_layout_v<S>, "libreadconf: bound structures need a standard layout");
+
+			auto trampoline = [](int problem, const char *name, const char *data, void *arg)
+			{
+				(*static_cast<std::remove_reference_t<F> *>(arg))(problem, std::string_view(name),
+					data != nullptr ? std::string_view(data) : std::string_view());
+			};
+
+			return config_bind_report(cfg_, fields, N, &out, trampoline, &report);
+		}
+
+	private:
+		CONFIG *cfg_ = nullptr;
+};
+
+}
+
+#endif
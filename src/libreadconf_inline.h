@@ -0,0 +1,99 @@
+/*
+ * This file is part of libreadconf.
+ *
+ * libreadconf is free software: you can redistribute it and/or modify
+ * it under the terms of the GNU Lesser General Public License as published by
+ * the Free Software Foundation, either version 2.1 of the License, or
+ * (at your option) any later version.
+ *
+ * libreadconf is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU Lesser General Public License for more details.
+ *
+ * You should have received a copy of the GNU Lesser General Public License
+ * along with libreadconf.  If not, see <https://www.gnu.org/licenses/>.
+ */
+#ifndef LIBREADCONF_INLINE_H
+#define LIBREADCONF_INLINE_H
+
+// An opt-in header of read-only accessors that the compiler can
+// inline into the caller.
+//
+// config_view() lays the keylist of a CONFIG out once as a
+// plain array of entries, in file order. Everything else here
+// is a static inline function over that array, so a loop over
+// the keys doesn't make a single call into the library.
+//
+// The layout of 'struct config_entry' and 'struct config_view'
+// is part of the interface, and won't change without a new
+// _LIBREADCONF_VSPEC_.
+
+#include "libreadconf.h"
+
+#ifdef __cplusplus
+extern "C"{
+#endif
+
+// One item from the keylist.
+// Items that aren't keys (tags) have a value of "\n".
+struct config_entry
+{
+	config_sv name;
+	config_sv value;
+};
+
+struct config_view
+{
+	size_t                     count;
+	const struct config_entry *entries;
+};
+
+extern const struct config_view *config_view(CONFIG *cfg);
+
+static inline size_t config_view_count(const struct config_view *view)
+{
+	return view->count;
+}
+
+// Returns NULL once 'index' is past the last entry.
+static inline const struct config_entry *config_view_entry(const struct config_view *view, size_t index)
+{
+	return (index < view->count) ? &view->entries[index] : NULL;
+}
+
+// These match config_index_sv(), returning 1, or 0 once
+// 'index' is past the last entry.
+static inline int config_view_index_sv(const struct config_view *view, size_t index, config_sv *name, config_sv *data)
+{
+	if(index >= view->count)
+		return 0;
+
+	if(name != NULL)
+		*name = view->entries[index].name;
+	if(data != NULL)
+		*data = view->entries[index].value;
+
+	return 1;
+}
+
+static inline const char *config_view_name(const struct config_view *view, size_t index)
+{
+	return (index < view->count) ? view->entries[index].name.ptr : NULL;
+}
+
+static inline const char *config_view_value(const struct config_view *view, size_t index)
+{
+	return (index < view->count) ? view->entries[index].value.ptr : NULL;
+}
+
+static inline int config_view_is_tag(const struct config_view *view, size_t index)
+{
+	return (index < view->count) && view->entries[index].value.len == 1 && view->entries[index].value.ptr[0] == '\n';
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif